@@ -0,0 +1,103 @@
+#include "async_file_writer.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "log.hpp"
+
+AsyncFileWriter::AsyncFileWriter(const std::string &filename,
+  const size_t buffer_size)
+  : file_(fopen(filename.c_str(), "wb"))
+  , buffer_size_(buffer_size)
+  , back_buffer_full_(false)
+  , stop_(false)
+  , error_(false)
+{
+  if (!file_)
+  {
+    Log::Error() << "ERROR: Couldn't open " << filename << std::endl;
+    return;
+  }
+  front_buffer_.reserve(buffer_size_);
+  back_buffer_.reserve(buffer_size_);
+  thread_ = std::thread(&AsyncFileWriter::Run, this);
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+  Close();
+}
+
+void AsyncFileWriter::Write(const uint8_t* const data, const size_t length)
+{
+  if (!file_)
+    return;
+
+  for (size_t i = 0; i < length; )
+  {
+    const size_t count = std::min(length - i, buffer_size_
+      - front_buffer_.size());
+    front_buffer_.insert(front_buffer_.end(), data + i, data + i + count);
+    i += count;
+    if (front_buffer_.size() == buffer_size_)
+      SwapBuffers();
+  }
+}
+
+bool AsyncFileWriter::Close()
+{
+  if (!file_)
+    return !error_;
+
+  SwapBuffers();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  thread_.join();
+
+  if (fclose(file_))
+    error_ = true;
+  file_ = nullptr;
+  if (error_)
+    Log::Error() << "ERROR: Failed to write the output file." << std::endl;
+  return !error_;
+}
+
+// ============================================================================+
+// Private  functions:
+
+// Hands the front buffer to the writer thread, waiting for it to finish with
+// the previous one first.
+void AsyncFileWriter::SwapBuffers()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  condition_.wait(lock, [this]() { return !back_buffer_full_; });
+  front_buffer_.swap(back_buffer_);
+  front_buffer_.clear();
+  back_buffer_full_ = true;
+  lock.unlock();
+  condition_.notify_all();
+}
+
+// -----------------------------------------------------------------------------
+void AsyncFileWriter::Run()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true)
+  {
+    condition_.wait(lock, [this]() { return back_buffer_full_ || stop_; });
+    if (!back_buffer_full_)
+      break;  // Stopped with nothing left to write.
+
+    // The back buffer belongs to this thread until it is marked empty.
+    lock.unlock();
+    if (fwrite(back_buffer_.data(), 1, back_buffer_.size(), file_)
+      != back_buffer_.size())
+      error_ = true;
+    lock.lock();
+    back_buffer_full_ = false;
+    condition_.notify_all();
+  }
+}
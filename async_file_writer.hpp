@@ -0,0 +1,52 @@
+// Double-buffered file writer: data is collected in one buffer while the other
+// is written to disk by a background thread, so that producing the data (e.g.
+// reading it from a serial port) overlaps the disk I/O.
+
+#ifndef ASYNC_FILE_WRITER_H_
+#define ASYNC_FILE_WRITER_H_
+
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class AsyncFileWriter
+{
+public:
+  AsyncFileWriter(const std::string &filename,
+    const size_t buffer_size = 64 * 1024);
+  ~AsyncFileWriter();
+
+  operator bool() const { return file_ != nullptr; }
+
+  void Write(const uint8_t* const data, const size_t length);
+  void Write(const std::string &text)
+    { Write(reinterpret_cast<const uint8_t*>(text.data()), text.length()); }
+
+  // Writes out any remaining data and closes the file. Returns false if any
+  // write failed.
+  bool Close();
+
+private:
+  AsyncFileWriter();
+  AsyncFileWriter(const AsyncFileWriter&);
+
+  void SwapBuffers();
+  void Run();
+
+  FILE* file_;
+  const size_t buffer_size_;
+  std::vector<uint8_t> front_buffer_;  // Being filled by Write.
+  std::vector<uint8_t> back_buffer_;  // Being written to the file.
+  bool back_buffer_full_;
+  bool stop_;
+  bool error_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::thread thread_;
+};
+
+#endif // ASYNC_FILE_WRITER_H_
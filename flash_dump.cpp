@@ -0,0 +1,109 @@
+#include "flash_dump.hpp"
+
+#include <algorithm>
+
+static bool EndsWith(const std::string &text, const std::string &suffix)
+{
+  return (text.length() >= suffix.length()) && (text.compare(text.length()
+    - suffix.length(), suffix.length(), suffix) == 0);
+}
+
+FlashDump::FlashDump(const std::string &dump_filename)
+  : writer_(dump_filename)
+  , hex_format_(EndsWith(dump_filename, ".hex")
+    || EndsWith(dump_filename, ".HEX"))
+  , address_(0)
+  , content_bytes_(0)
+  , pending_erased_bytes_(0)
+  , extended_address_(0)
+{
+}
+
+void FlashDump::Write(const uint8_t* const data, const int length)
+{
+  for (int i = 0; i < length; ++i)
+  {
+    if (data[i] != 0xFF)
+      content_bytes_ = address_ + 1;
+    ++address_;
+
+    if (hex_format_)
+    {
+      hex_line_.push_back(data[i]);
+      if (address_ % kHexLineLength == 0)
+        FlushHexLine();
+    }
+    else if (data[i] == 0xFF)
+    {
+      // Hold back erased bytes until it's known that more content follows.
+      ++pending_erased_bytes_;
+    }
+    else
+    {
+      const std::vector<uint8_t> erased(pending_erased_bytes_, 0xFF);
+      writer_.Write(erased.data(), erased.size());
+      pending_erased_bytes_ = 0;
+      writer_.Write(&data[i], 1);
+    }
+  }
+}
+
+bool FlashDump::Close()
+{
+  if (hex_format_)
+  {
+    FlushHexLine();
+    WriteHexRecord(1, 0, nullptr, 0);  // End of file.
+  }
+  return writer_.Close();
+}
+
+// ============================================================================+
+// Private  functions:
+
+// Writes the collected line of data unless it is entirely erased.
+void FlashDump::FlushHexLine()
+{
+  const int line_address = address_ - hex_line_.size();
+  if (std::any_of(hex_line_.begin(), hex_line_.end(),
+    [](uint8_t byte) { return byte != 0xFF; }))
+  {
+    // Records only hold 16-bit addresses, so emit an extended segment address
+    // record whenever a line is in a different 64 kB segment than the last.
+    if ((line_address & ~0xFFFF) != extended_address_)
+    {
+      extended_address_ = line_address & ~0xFFFF;
+      const uint8_t segment[2] = { (uint8_t)(extended_address_ >> 12),
+        (uint8_t)(extended_address_ >> 4) };
+      WriteHexRecord(2, 0, segment, sizeof(segment));
+    }
+    WriteHexRecord(0, line_address & 0xFFFF, hex_line_.data(),
+      hex_line_.size());
+  }
+  hex_line_.clear();
+}
+
+// -----------------------------------------------------------------------------
+void FlashDump::WriteHexRecord(const int record_type, const int address,
+  const uint8_t* const data, const int length)
+{
+  constexpr char kHexDigits[] = "0123456789ABCDEF";
+  std::string line = ":";
+  int checksum = 0;
+  auto append_byte = [&](const uint8_t byte) {
+    line += kHexDigits[byte >> 4];
+    line += kHexDigits[byte & 0x0F];
+    checksum += byte;
+  };
+
+  append_byte(length);
+  append_byte((address >> 8) & 0xFF);
+  append_byte(address & 0xFF);
+  append_byte(record_type);
+  for (int i = 0; i < length; ++i)
+    append_byte(data[i]);
+  append_byte((-checksum) & 0xFF);
+  line += "\r\n";
+
+  writer_.Write(line);
+}
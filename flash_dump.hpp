@@ -0,0 +1,46 @@
+// Writes flash contents, as they are read from a device, to an Intel HEX file
+// (if the filename ends in ".hex") or a raw binary file. Erased (0xFF) flash
+// is left out of hex files, and trailing erased flash is left out of binary
+// files.
+
+#ifndef FLASH_DUMP_H_
+#define FLASH_DUMP_H_
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+
+#include "async_file_writer.hpp"
+
+class FlashDump
+{
+public:
+  FlashDump(const std::string &dump_filename);
+
+  operator bool() const { return writer_; }
+
+  // Appends the next length bytes of flash.
+  void Write(const uint8_t* const data, const int length);
+  bool Close();
+
+  int content_bytes() const { return content_bytes_; }
+
+private:
+  FlashDump();
+
+  void WriteHexRecord(const int record_type, const int address,
+    const uint8_t* const data, const int length);
+  void FlushHexLine();
+
+  static constexpr int kHexLineLength = 16;
+
+  AsyncFileWriter writer_;
+  bool hex_format_;
+  int address_;  // Address of the next byte to be written.
+  int content_bytes_;  // Bytes up to and including the last non-erased byte.
+  int pending_erased_bytes_;  // Binary format only.
+  int extended_address_;  // Hex format only.
+  std::vector<uint8_t> hex_line_;  // Hex format only.
+};
+
+#endif // FLASH_DUMP_H_
@@ -0,0 +1,85 @@
+#include "flash_time_model.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "run_stats.hpp"
+
+// Rough defaults for uncalibrated models: reset and bootloader wake-up,
+// acknowledgement of a block over a USB adapter with a 16 ms latency timer,
+// and page-by-page erasing (per byte cleared, which for the AVRs is their whole
+// flash whatever the image size).
+static constexpr double kDefaultHandshakeSeconds = 1.0;
+static constexpr double kDefaultAckRoundTripSeconds = 0.02;
+static constexpr double kDefaultEraseSecondsPerByte = 1.6e-5;
+
+// 8N1 framing: 10 bits per byte.
+static double ByteSeconds(const int baudrate)
+{
+  return 10.0 / baudrate;
+}
+
+FlashTimeModel::FlashTimeModel(const MKComms::DeviceType device_type,
+  const int baudrate)
+  : device_type_(device_type)
+  , byte_seconds_(ByteSeconds(baudrate))
+  , handshake_seconds_(kDefaultHandshakeSeconds)
+  , ack_round_trip_seconds_(kDefaultAckRoundTripSeconds)
+  , erase_seconds_per_byte_(kDefaultEraseSecondsPerByte)
+  , program_block_size_(MKComms::DefaultProgramBlockSize(device_type))
+{
+}
+
+int FlashTimeModel::Calibrate(const std::string &stats_filename)
+{
+  std::vector<RunStats> runs;
+  if (!RunStats::Load(stats_filename, runs))
+    return 0;
+
+  int count = 0;
+  // Summed over whole flashes, which overflows an int in a long stats file.
+  double erased_bytes = 0.0;
+  double handshake_seconds = 0.0, ack_round_trip_seconds = 0.0;
+  double erase_seconds = 0.0;
+  for (const RunStats &run : runs)
+  {
+    if (!run.success || (run.device_type != device_type_) || (run.blocks < 1)
+      || (run.baudrate < 1))
+      continue;
+
+    // Whatever programming time isn't accounted for by the bytes on the wire
+    // is spent waiting for acknowledgements.
+    const int program_bytes_sent = run.program_bytes_sent ?
+      run.program_bytes_sent : run.blocks * (run.program_block_size
+      + MKComms::kBlockLoadOverheadBytes);
+    ack_round_trip_seconds += (run.program_seconds - program_bytes_sent
+      * ByteSeconds(run.baudrate)) / run.blocks;
+    handshake_seconds += run.handshake_seconds;
+    erase_seconds += run.erase_seconds;
+    if (run.program_block_size > 0)
+      program_block_size_ = run.program_block_size;
+    erased_bytes += MKComms::BytesCleared(device_type_, run.image_bytes);
+    ++count;
+  }
+
+  if (count)
+  {
+    handshake_seconds_ = handshake_seconds / count;
+    ack_round_trip_seconds_ = std::max(ack_round_trip_seconds / count, 0.0);
+    if (erased_bytes)
+      erase_seconds_per_byte_ = erase_seconds / erased_bytes;
+  }
+  return count;
+}
+
+FlashTimeModel::Prediction FlashTimeModel::Predict(const int image_bytes,
+  const int blocks, const int program_bytes_sent) const
+{
+  Prediction prediction;
+  prediction.handshake_seconds = handshake_seconds_;
+  prediction.erase_seconds = MKComms::BytesCleared(device_type_, image_bytes)
+    * erase_seconds_per_byte_;
+  prediction.program_seconds = program_bytes_sent * byte_seconds_
+    + blocks * ack_round_trip_seconds_;
+  return prediction;
+}
@@ -0,0 +1,51 @@
+// Predicts how long each phase of programming a device will take, from the
+// image, the link, and per-device timing that can be calibrated from the stats
+// of previous runs (see RunStats).
+
+#ifndef FLASH_TIME_MODEL_H_
+#define FLASH_TIME_MODEL_H_
+
+#include <string>
+
+#include "mk_comms.hpp"
+
+class FlashTimeModel
+{
+public:
+  struct Prediction
+  {
+    double handshake_seconds;
+    double erase_seconds;
+    double program_seconds;
+    double total_seconds() const { return handshake_seconds + erase_seconds
+      + program_seconds; }
+  };
+
+  FlashTimeModel(const MKComms::DeviceType device_type, const int baudrate);
+
+  // Replaces the default timing with averages over the successful runs for
+  // this device type in the stats file, and the default program block size
+  // with the latest of theirs. Returns the number of runs used.
+  int Calibrate(const std::string &stats_filename);
+
+  // program_bytes_sent covers the block headers, data, and CRCs of all blocks.
+  Prediction Predict(const int image_bytes, const int blocks,
+    const int program_bytes_sent) const;
+
+  double ack_round_trip_seconds() const { return ack_round_trip_seconds_; }
+  // The program block size of the latest calibration run (the bootloader's
+  // real one), or the device type's default.
+  int program_block_size() const { return program_block_size_; }
+
+private:
+  FlashTimeModel();
+
+  const MKComms::DeviceType device_type_;
+  const double byte_seconds_;
+  double handshake_seconds_;
+  double ack_round_trip_seconds_;  // Includes writing the block to flash.
+  double erase_seconds_per_byte_;
+  int program_block_size_;
+};
+
+#endif // FLASH_TIME_MODEL_H_
@@ -1,19 +1,123 @@
 #include "intel_hex.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <iostream>
 
+#include "log.hpp"
+#include "sha256.hpp"
+
 IntelHex::IntelHex(const std::string &hex_filename)
   : hex_filename_(hex_filename)
   , total_bytes_(0)
   , program_()
+  , current_line_well_formed_(false)
   , end_of_file_(false)
+  , end_of_stream_(false)
+  , valid_(false)
 {
   // Open the hex file and scan it to discover any extended address blocks.
   hex_file_.open(hex_filename);
   if (hex_file_)
     Read();
   else
-    std::cerr << "ERROR: Couldn't open " << hex_filename << std::endl;
+    Log::Error() << "ERROR: Couldn't open " << hex_filename << std::endl;
+}
+
+IntelHex::IntelHex(const std::vector<const IntelHex*> &parts)
+  : total_bytes_(0)
+  , program_()
+  , current_line_well_formed_(false)
+  , end_of_file_(true)
+  , end_of_stream_(false)
+  , valid_(false)
+{
+  struct PartRecord
+  {
+    const IntelHex* part;
+    Record record;
+  };
+  std::vector<PartRecord> records;
+  for (const IntelHex* part : parts)
+  {
+    if (!hex_filename_.empty())
+      hex_filename_ += " + ";
+    hex_filename_ += part->hex_filename_;
+    for (const Record &record : part->records_)
+      records.push_back({ part, record });
+  }
+
+  // Sweep through the records in address order, comparing each with the
+  // furthest reaching record before it.
+  std::sort(records.begin(), records.end(),
+    [](const PartRecord &a, const PartRecord &b)
+      { return a.record.address < b.record.address; });
+  constexpr int kMaxReportedOverlaps = 10;
+  int overlaps = 0;
+  const PartRecord* furthest = nullptr;
+  for (const PartRecord &current : records)
+  {
+    if (furthest && (current.record.address < furthest->record.address
+      + furthest->record.length) && (current.part != furthest->part)
+      && (++overlaps <= kMaxReportedOverlaps))
+    {
+      Log::Error() << "ERROR: Data at " << current.part->hex_filename_ << ": "
+        << current.record.line_number << " overlaps "
+        << furthest->part->hex_filename_ << ": "
+        << furthest->record.line_number << " (address 0x" << std::hex
+        << current.record.address << std::dec << ")." << std::endl;
+    }
+    if (!furthest || (current.record.address + current.record.length
+      > furthest->record.address + furthest->record.length))
+      furthest = &current;
+  }
+  if (overlaps > kMaxReportedOverlaps)
+    Log::Error() << "ERROR: " << overlaps - kMaxReportedOverlaps
+      << " more overlapping record(s)." << std::endl;
+  if (overlaps)
+    return;
+
+  for (const PartRecord &current : records)
+  {
+    memcpy(program_ + current.record.address, current.part->program_
+      + current.record.address, current.record.length);
+    records_.push_back(current.record);
+  }
+  for (const IntelHex* part : parts)
+    total_bytes_ = std::max(total_bytes_, part->total_bytes_);
+
+  Log::Info() << "Combined image contains " << total_bytes_ << " bytes."
+    << std::endl;
+  valid_ = true;
+}
+
+// -----------------------------------------------------------------------------
+int IntelHex::NonEmptyBlocks(const int program_block_size) const
+{
+  if (total_bytes_ < 1)
+    return 0;
+  std::vector<bool> non_empty((total_bytes_ - 1) / program_block_size + 1);
+  for (const Record &record : records_)
+  {
+    if (record.length < 1)
+      continue;
+    const int first = record.address / program_block_size;
+    const int last = (record.address + record.length - 1) / program_block_size;
+    std::fill(non_empty.begin() + first, non_empty.begin() + last + 1, true);
+  }
+  return std::count(non_empty.begin(), non_empty.end(), true);
+}
+
+// -----------------------------------------------------------------------------
+// The normalized image is the contiguous range of bytes from address 0 up to
+// the last byte recorded in the hex file, with unrecorded gaps left as zeros.
+// This is exactly what SendProgram transmits, so it is what gets hashed.
+std::string IntelHex::Digest() const
+{
+  SHA256 sha256;
+  sha256.Update(program_, total_bytes_);
+  return sha256.result();
 }
 
 // ============================================================================+
@@ -24,37 +128,70 @@ bool IntelHex::GetLine()
 {
   if (!hex_file_.is_open()) return false;
   current_line_position_ = hex_file_.tellg();
-  if(end_of_file_ || std::getline(hex_file_, current_line_).eof()
-    || (current_line_.length() < 12))
+  current_line_well_formed_ = false;
+  end_of_stream_ = false;
+  if (end_of_file_ || !std::getline(hex_file_, current_line_))
   {
+    // Running out of lines before the end of file record means the file has
+    // been truncated.
+    end_of_stream_ = !end_of_file_;
     current_line_record_type_ = RECORD_TYPE_END_OF_FILE;
     current_line_byte_count_ = 0;
     end_of_file_ = true;
+    return false;
   }
-  else
+
+  // Tolerate DOS line endings.
+  if (!current_line_.empty() && current_line_.back() == '\r')
+    current_line_.pop_back();
+
+  // Read the record type and number of data bytes for the current line of the
+  // hex file, but only after checking that they are there to be read.
+  constexpr int kRecordTypePos = 7;
+  constexpr int kRecordTypeLen = 2;
+  constexpr int kByteCountPos = 1;
+  constexpr int kByteCountLen = 2;
+  constexpr size_t kMinLineLength = 11;
+
+  if (!LineWellFormed(kMinLineLength))
   {
-    // Read the record type and number of data bytes for the current line of the
-    // hex file.
-    constexpr int kRecordTypePos = 7;
-    constexpr int kRecordTypeLen = 2;
-    constexpr int kByteCountPos = 1;
-    constexpr int kByteCountLen = 2;
-
-    int raw_type = std::stoi(current_line_.substr(kRecordTypePos,
-      kRecordTypeLen), nullptr, 16);
-    if (raw_type >= 0 && raw_type < 4)
-      current_line_record_type_ = static_cast<RecordType>(raw_type);
-    else
-      current_line_record_type_ = RECORD_TYPE_UNSUPPORTED;
-    current_line_byte_count_ =  std::stoi(current_line_.substr(kByteCountPos,
-      kByteCountLen), nullptr, 16);
-
-    end_of_file_ = current_line_record_type_ == RECORD_TYPE_END_OF_FILE;
+    current_line_record_type_ = RECORD_TYPE_UNSUPPORTED;
+    current_line_byte_count_ = 0;
+    return true;
   }
 
+  int raw_type = std::stoi(current_line_.substr(kRecordTypePos,
+    kRecordTypeLen), nullptr, 16);
+  if (raw_type >= 0 && raw_type < 4)
+    current_line_record_type_ = static_cast<RecordType>(raw_type);
+  else
+    current_line_record_type_ = RECORD_TYPE_UNSUPPORTED;
+  current_line_byte_count_ =  std::stoi(current_line_.substr(kByteCountPos,
+    kByteCountLen), nullptr, 16);
+
+  // The line must hold exactly the data bytes its byte count announces.
+  current_line_well_formed_ = current_line_.length()
+    == kMinLineLength + 2 * static_cast<size_t>(current_line_byte_count_);
+
+  end_of_file_ = current_line_record_type_ == RECORD_TYPE_END_OF_FILE;
+
   return !end_of_file_;
 }
 
+// -----------------------------------------------------------------------------
+// Check that the current line is a ':' followed by an even number (at least
+// min_length - 1) of hexadecimal digits, so that it can be parsed safely.
+bool IntelHex::LineWellFormed(size_t min_length) const
+{
+  if ((current_line_.length() < min_length) || (current_line_[0] != ':')
+    || (current_line_.length() % 2 == 0))
+    return false;
+  for (size_t i = 1; i < current_line_.length(); ++i)
+    if (!std::isxdigit(static_cast<unsigned char>(current_line_[i])))
+      return false;
+  return true;
+}
+
 // -----------------------------------------------------------------------------
 // Read the address for the current line of the hex file.
 int IntelHex::GetAddress() const
@@ -85,11 +222,31 @@ int IntelHex::GetChecksum() const
 {
   if (!hex_file_.is_open()) return -1;
 
-  // Note that length includes a carriage return at the end of the line.
-  return std::stoi(current_line_.substr(current_line_.length() - 3, 2), nullptr,
+  // Any carriage return has already been stripped from the end of the line.
+  return std::stoi(current_line_.substr(current_line_.length() - 2, 2), nullptr,
     16);
 }
 
+// -----------------------------------------------------------------------------
+// Check that all of the bytes in the current record, including the checksum,
+// sum to zero (modulo 256).
+bool IntelHex::ChecksumValid() const
+{
+  if (!hex_file_.is_open()) return false;
+
+  // Byte count, address (2), record type, data, and checksum.
+  const int record_bytes = current_line_byte_count_ + 5;
+  if (current_line_.length() < static_cast<size_t>(1 + 2 * record_bytes))
+    return false;
+
+  int sum = 0;
+  for (int i = 0; i < record_bytes; ++i)
+    sum += std::stoi(current_line_.substr(1 + 2 * i, 2), nullptr, 16);
+
+  return (sum & 0xFF) == 0;
+}
+
+// -----------------------------------------------------------------------------
 // Reads the contents of the hex file into RAM (program_).
 void IntelHex::Read()
 {
@@ -99,18 +256,55 @@ void IntelHex::Read()
   GoToFirstLine();
   int extended_address = 0;
 
-  int line_number = 0;
-  do
+  // Every record, including the end of file record, is checked.
+  for (int line_number = 1; ; ++line_number)
   {
-    ++line_number;
+    if (end_of_stream_)
+    {
+      Log::Error() << "ERROR: " << hex_filename_
+        << " has no end of file record (truncated?)." << std::endl;
+      Close();
+      return;
+    }
+    if (!current_line_well_formed_)
+    {
+      Log::Error() << "ERROR: Can't interpret text at " << hex_filename_
+        << ": " << line_number << "." << std::endl;
+      Close();
+      return;
+    }
+    if (!ChecksumValid())
+    {
+      Log::Error() << "ERROR: Checksum mismatch at " << hex_filename_ << ": "
+        << line_number << "." << std::endl;
+      Close();
+      return;
+    }
+    if (current_line_record_type_ == RECORD_TYPE_END_OF_FILE)
+    {
+      if (current_line_byte_count_ == 0)
+        break;
+      Log::Error() << "ERROR: Can't interpret text at " << hex_filename_
+        << ": " << line_number << "." << std::endl;
+      Close();
+      return;
+    }
     switch (current_line_record_type_)
     {
       case RECORD_TYPE_DATA:
       {
         int address = extended_address + GetAddress();
+        if (address + current_line_byte_count_ > kMaxProgramBytes)
+        {
+          Log::Error() << "ERROR: Address out of range at " << hex_filename_
+            << ": " << line_number << "." << std::endl;
+          Close();
+          return;
+        }
         // Read the data into the program array.
         for (int i = 0; i < current_line_byte_count_; ++i)
           program_[address + i] = GetData(i);
+        records_.push_back({ address, current_line_byte_count_, line_number });
         // Update estimate for total program bytes.
         int temp = address + current_line_byte_count_;
         if (temp > total_bytes_)
@@ -119,29 +313,38 @@ void IntelHex::Read()
       }
       case RECORD_TYPE_EXTENDED_ADDRESS:
       {
-        extended_address = (GetData(0) << 12) + (GetData(1) << 4);
-        break;
+        if (current_line_byte_count_ == 2)
+        {
+          extended_address = (GetData(0) << 12) + (GetData(1) << 4);
+          break;
+        }
       }
+      // Fall through.
       default:
       {
-        std::cerr << "ERROR: Can't interpret text at " << hex_filename_ << ": "
-          << line_number << "." << std::endl;
+        Log::Error() << "ERROR: Can't interpret text at " << hex_filename_
+          << ": " << line_number << "." << std::endl;
         Close();
         return;
         break;
       }
     }
-  } while (GetLine());
+    GetLine();
+  }
 
-  std::cout << hex_filename_ << " contains " << total_bytes_ << " bytes."
+  Log::Info() << hex_filename_ << " contains " << total_bytes_ << " bytes."
     << std::endl;
 
   GoToFirstLine();
+  valid_ = true;
 }
 // -----------------------------------------------------------------------------
 // Go to the final line of the hex file (should an end of file record).
 void IntelHex::GoToFirstLine()
 {
+  // Reaching the end of the file leaves the stream failed, and then tellg()
+  // returns -1 rather than a position.
+  hex_file_.clear();
   hex_file_.seekg(0, hex_file_.beg);
   GoToBeginningOfLine();
 }
@@ -150,6 +353,7 @@ void IntelHex::GoToFirstLine()
 // Go to the final line of the hex file (should an end of file record).
 void IntelHex::GoToFinalLine()
 {
+  hex_file_.clear();
   hex_file_.seekg(-1, hex_file_.end);
   GoToBeginningOfLine();
 }
@@ -158,6 +362,7 @@ void IntelHex::GoToFinalLine()
 // Go to the previous line of the hex file.
 void IntelHex::GoToPreviousLine()
 {
+  hex_file_.clear();
   if (current_line_position_ > 0)
     hex_file_.seekg(current_line_position_ - 1L);
   GoToBeginningOfLine();
@@ -167,7 +372,7 @@ void IntelHex::GoToPreviousLine()
 // Go to the beginning of the current line (assuming it starts with a ':').
 void IntelHex::GoToBeginningOfLine()
 {
-  while (hex_file_.tellg() && hex_file_.peek() != ':')
+  while ((hex_file_.tellg() > 0) && hex_file_.peek() != ':')
     hex_file_.unget();
   end_of_file_ = false;
   GetLine();
@@ -177,6 +382,7 @@ void IntelHex::GoToBeginningOfLine()
 // Jump to the line at the specified stream position.
 void IntelHex::GoToLineAtPosition(std::streampos position)
 {
+  hex_file_.clear();
   hex_file_.seekg(position);
   GoToBeginningOfLine();
 }
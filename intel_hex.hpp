@@ -16,24 +16,48 @@ public:
     RECORD_TYPE_UNSUPPORTED = 3,
   };
 
+  // The largest image the 20-bit extended addresses can describe.
+  static constexpr int kMaxProgramBytes = 1024 * 1024;
+
   IntelHex(const std::string &hex_file_name);
+  // Combines several parsed hex files into one image, failing if any of them
+  // record data at the same address.
+  IntelHex(const std::vector<const IntelHex*> &parts);
 
-  operator bool() const { return hex_file_.is_open(); }
+  operator bool() const { return valid_; }
 
   // The number of program bytes recorded in the hex file
   int size() const { return total_bytes_; }
-  uint8_t* program() { return program_; }
+  const uint8_t* program() const { return program_; }
+  std::string filename() const { return hex_filename_; }
+
+  // The number of program blocks that contain data from the hex file(s), as
+  // opposed to only the padding between records.
+  int NonEmptyBlocks(const int program_block_size) const;
+
+  // SHA-256 of the normalized image (the bytes that will be flashed).
+  std::string Digest() const;
 
 private:
   IntelHex();
 
+  // The location of a data record, for reporting overlaps.
+  struct Record
+  {
+    int address;
+    int length;
+    int line_number;
+  };
+
   // Get the next line of the hex file.
   bool GetLine();
+  bool LineWellFormed(size_t min_length) const;
 
   // Read various records from the current line of the hex file.
   int GetAddress() const;
   int GetData(int n) const;
   int GetChecksum() const;
+  bool ChecksumValid() const;
 
   void Read();
 
@@ -51,9 +75,14 @@ private:
   enum RecordType current_line_record_type_;
   int current_line_byte_count_;
   int total_bytes_;
-  uint8_t program_[1024*1024];
+  uint8_t program_[kMaxProgramBytes];
+  std::vector<Record> records_;
 
+  bool current_line_well_formed_;
   bool end_of_file_;
+  // Set when the file ended before its end of file record.
+  bool end_of_stream_;
+  bool valid_;
 };
 
 #endif // INTEL_HEX_H_
\ No newline at end of file
@@ -0,0 +1,141 @@
+#include "inventory.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "log.hpp"
+
+static std::string JSONString(const std::string &text)
+{
+  std::string quoted = "\"";
+  for (const char c : text)
+  {
+    if ((c == '"') || (c == '\\'))
+      quoted += '\\';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+// ============================================================================+
+// Public functions:
+
+Inventory::Inventory(const std::vector<std::string> &serial_ports,
+  const int baudrate, const int timeout_ms)
+  : valid_(true)
+{
+  std::vector<std::future<Entry>> probes;
+  for (const std::string &serial_port : serial_ports)
+  {
+    probes.push_back(std::async(std::launch::async,
+      [serial_port, baudrate, timeout_ms]() {
+        // The progress messages of all of the probes would be interleaved, so
+        // they are dropped.
+        Log::ScopedSink quiet([](const bool, const std::string &) {});
+        Entry entry;
+        entry.serial_port = serial_port;
+        MKComms mk_comms(serial_port, baudrate);
+        entry.responded = mk_comms && mk_comms.Identify(timeout_ms,
+          entry.info);
+        return entry;
+      }));
+  }
+  for (std::future<Entry> &probe : probes)
+    entries_.push_back(probe.get());
+}
+
+Inventory::Inventory(const std::string &inventory_filename)
+  : valid_(false)
+{
+  std::ifstream inventory_file(inventory_filename);
+  if (!inventory_file)
+  {
+    Log::Error() << "ERROR: Couldn't open " << inventory_filename << std::endl;
+    return;
+  }
+
+  std::string line;
+  int line_number = 0;
+  while (std::getline(inventory_file, line))
+  {
+    ++line_number;
+    std::istringstream line_stream(line);
+    Entry entry;
+    std::string signature, block_size;
+    if (!(line_stream >> entry.serial_port) || (entry.serial_port[0] == '#'))
+      continue;  // Blank line or heading.
+    line_stream >> signature >> entry.info.version >> block_size;
+
+    entry.responded = signature != "-";
+    if (entry.responded)
+    {
+      char* signature_end = nullptr;
+      char* block_size_end = nullptr;
+      entry.info.device_type = std::strtol(signature.c_str(), &signature_end,
+        16);
+      entry.info.program_block_size = std::strtol(block_size.c_str(),
+        &block_size_end, 10);
+      if (signature.empty() || block_size.empty() || *signature_end
+        || *block_size_end)
+      {
+        Log::Error() << "ERROR: Can't interpret text at " << inventory_filename
+          << ": " << line_number << "." << std::endl;
+        return;
+      }
+    }
+    entries_.push_back(entry);
+  }
+  valid_ = true;
+}
+
+void Inventory::PrintTable(std::ostream &out) const
+{
+  out << std::left << std::setw(16) << "# port" << std::setw(11) << "signature"
+    << std::setw(12) << "bootloader" << std::setw(12) << "block-size"
+    << "board\n";
+  for (const Entry &entry : entries_)
+  {
+    out << std::setw(16) << entry.serial_port;
+    if (!entry.responded)
+    {
+      out << std::setw(11) << "-" << std::setw(12) << "-" << std::setw(12)
+        << "-" << "(no bootloader)\n";
+      continue;
+    }
+    std::ostringstream signature;
+    signature << "0x" << std::hex << std::setw(2) << std::setfill('0')
+      << std::right << entry.info.device_type;
+    const std::string board_name = MKComms::BoardName(
+      static_cast<MKComms::DeviceType>(entry.info.device_type));
+    out << std::setw(11) << signature.str() << std::setw(12)
+      << entry.info.version << std::setw(12) << entry.info.program_block_size
+      << (board_name.empty() ? "(unsupported)" : board_name) << "\n";
+  }
+  out << std::flush;
+}
+
+void Inventory::PrintJSON(std::ostream &out) const
+{
+  out << "[";
+  for (size_t i = 0; i < entries_.size(); ++i)
+  {
+    const Entry &entry = entries_[i];
+    out << (i ? ",\n  " : "\n  ") << "{ \"port\": "
+      << JSONString(entry.serial_port) << ", \"responded\": "
+      << (entry.responded ? "true" : "false");
+    if (entry.responded)
+    {
+      out << ", \"device_type\": " << entry.info.device_type << ", \"board\": "
+        << JSONString(MKComms::BoardName(static_cast<MKComms::DeviceType>(
+        entry.info.device_type))) << ", \"bootloader_version\": "
+        << JSONString(entry.info.version) << ", \"program_block_size\": "
+        << entry.info.program_block_size;
+    }
+    out << " }";
+  }
+  out << "\n]" << std::endl;
+}
@@ -0,0 +1,42 @@
+#ifndef INVENTORY_H_
+#define INVENTORY_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "mk_comms.hpp"
+
+// The MikroKopter bootloaders found on a set of serial ports. A scan probes
+// all of the ports at once without changing anything on the devices. The
+// table that it prints can be read back as the list of ports for a batch.
+class Inventory
+{
+public:
+  struct Entry
+  {
+    std::string serial_port;
+    bool responded;
+    MKComms::BootloaderInfo info;  // Only valid if responded.
+  };
+
+  // Probes each port, waiting up to timeout_ms for a bootloader to answer.
+  Inventory(const std::vector<std::string> &serial_ports, const int baudrate,
+    const int timeout_ms);
+  // Reads a table printed by PrintTable.
+  Inventory(const std::string &inventory_filename);
+
+  operator bool() const { return valid_; }
+  const std::vector<Entry> &entries() const { return entries_; }
+
+  void PrintTable(std::ostream &out) const;
+  void PrintJSON(std::ostream &out) const;
+
+private:
+  Inventory();
+
+  std::vector<Entry> entries_;
+  bool valid_;
+};
+
+#endif // INVENTORY_H_
@@ -0,0 +1,99 @@
+#include "log.hpp"
+
+#include <iostream>
+#include <streambuf>
+
+// Passes characters straight through to the console, or collects them into
+// lines for the thread's sink.
+class LogBuffer : public std::streambuf
+{
+public:
+  LogBuffer(std::ostream &console, const bool error, const Log::Sink &sink)
+    : console_(console), error_(error), sink_(sink) {}
+
+protected:
+  int overflow(const int c) override
+  {
+    if (c == traits_type::eof())
+      return traits_type::not_eof(c);
+    if (!sink_)
+    {
+      console_.put(traits_type::to_char_type(c));
+    }
+    else if (c == '\n')
+    {
+      sink_(error_, line_);
+      line_.clear();
+    }
+    else
+    {
+      line_ += traits_type::to_char_type(c);
+    }
+    return c;
+  }
+
+  std::streamsize xsputn(const char* const s, const std::streamsize n)
+    override
+  {
+    if (sink_)
+      return std::streambuf::xsputn(s, n);
+    console_.write(s, n);
+    return n;
+  }
+
+  int sync() override
+  {
+    if (!sink_)
+      console_.flush();
+    return 0;
+  }
+
+public:
+  // Passes on an unterminated line before the sink is changed.
+  void FinishLine()
+  {
+    if (sink_ && !line_.empty())
+      sink_(error_, line_);
+    line_.clear();
+  }
+
+private:
+  std::ostream &console_;
+  const bool error_;
+  const Log::Sink &sink_;
+  std::string line_;
+};
+
+static thread_local Log::Sink sink;
+static thread_local LogBuffer info_buffer(std::cout, false, sink);
+static thread_local LogBuffer error_buffer(std::cerr, true, sink);
+
+// ============================================================================+
+// Public functions:
+
+std::ostream &Log::Info()
+{
+  static thread_local std::ostream stream(&info_buffer);
+  return stream;
+}
+
+std::ostream &Log::Error()
+{
+  static thread_local std::ostream stream(&error_buffer);
+  return stream;
+}
+
+Log::ScopedSink::ScopedSink(const Sink &new_sink)
+  : previous_sink_(sink)
+{
+  info_buffer.FinishLine();
+  error_buffer.FinishLine();
+  sink = new_sink;
+}
+
+Log::ScopedSink::~ScopedSink()
+{
+  info_buffer.FinishLine();
+  error_buffer.FinishLine();
+  sink = previous_sink_;
+}
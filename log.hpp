@@ -0,0 +1,40 @@
+// Destination of the messages printed by the programmer's classes. Messages go
+// to std::cout (information) and std::cerr (errors) unless the calling thread
+// has installed a sink, in which case the sink receives each complete line.
+// Since sinks are per thread, concurrent programming sessions can each report
+// to their own caller.
+
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <functional>
+#include <ostream>
+#include <string>
+
+class Log
+{
+public:
+  typedef std::function<void (const bool error, const std::string &line)> Sink;
+
+  static std::ostream &Info();
+  static std::ostream &Error();
+
+  // Installs a sink for the current thread for as long as this is in scope.
+  class ScopedSink
+  {
+  public:
+    ScopedSink(const Sink &sink);
+    ~ScopedSink();
+
+  private:
+    ScopedSink();
+    ScopedSink(const ScopedSink&);
+
+    Sink previous_sink_;
+  };
+
+private:
+  Log();
+};
+
+#endif // LOG_H_
@@ -1,8 +1,256 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
 
+#include "flash_dump.hpp"
+#include "flash_time_model.hpp"
 #include "intel_hex.hpp"
+#include "inventory.hpp"
+#include "log.hpp"
+#include "manifest.hpp"
 #include "mk_comms.hpp"
+#include "mk_simulator.hpp"
 #include "program_options.hpp"
+#include "programmer.hpp"
+#include "response_timer.hpp"
+#include "run_stats.hpp"
+#include "serial.hpp"
+#include "serial_trace.hpp"
+#include "trace_decoder.hpp"
+#include "trace_replay.hpp"
+
+// Records the outcome of a programming run in the stats file, if requested.
+static int Finish(const ProgramOptions &program_options, RunStats &stats,
+  const bool success)
+{
+  stats.success = success;
+  if (!program_options.stats_filename().empty())
+    stats.Append(program_options.stats_filename());
+  return success ? 0 : 1;
+}
+
+// Parses the hex files, up to jobs of them at a time.
+static std::vector<std::unique_ptr<IntelHex>> LoadImages(
+  const std::vector<std::string> &hex_filenames, const int jobs)
+{
+  std::vector<std::unique_ptr<IntelHex>> images(hex_filenames.size());
+  std::atomic<size_t> next_image(0);
+  std::vector<std::future<void>> workers;
+  const int worker_count = std::min<int>(std::max(jobs, 1),
+    hex_filenames.size());
+  for (int i = 0; i < worker_count; ++i)
+  {
+    workers.push_back(std::async(std::launch::async, [&]() {
+      for (size_t j; (j = next_image++) < hex_filenames.size(); )
+        images[j].reset(new IntelHex(hex_filenames[j]));
+    }));
+  }
+  // An image whose worker failed is left null.
+  for (std::future<void> &worker : workers)
+  {
+    try
+    {
+      worker.get();
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << "ERROR: Couldn't load the hex files: " << e.what()
+        << std::endl;
+    }
+  }
+  return images;
+}
+
+// Walks through the same block plan as SendProgram without a device and
+// prints the predicted duration of each phase.
+static bool DryRun(const ProgramOptions &program_options, IntelHex &hex)
+{
+  const MKComms::DeviceType device_type = MKComms::DeviceTypeForImage(
+    hex.filename());
+  if (device_type == MKComms::DEVICE_TYPE_UNSUPPORTED)
+  {
+    std::cerr << "ERROR: Can't tell the device type from the name of "
+      << hex.filename() << "." << std::endl;
+    return false;
+  }
+
+  FlashTimeModel model(device_type, program_options.baudrate());
+  int calibration_runs = 0;
+  if (!program_options.stats_filename().empty())
+    calibration_runs = model.Calibrate(program_options.stats_filename());
+
+  const int program_block_size = model.program_block_size();
+  const int blocks = (hex.size() - 1) / program_block_size + 1;
+  int program_bytes_sent = 0;
+  for (int i = 0; i < blocks; ++i)
+    program_bytes_sent += MKComms::BlockBytesSent(hex.program() + i
+      * program_block_size, program_block_size, program_options.compress());
+
+  const FlashTimeModel::Prediction prediction = model.Predict(hex.size(),
+    blocks, program_bytes_sent);
+
+  std::cout << "Dry run: " << hex.size() << " bytes in " << blocks
+    << " blocks of " << program_block_size << " bytes ("
+    << hex.NonEmptyBlocks(program_block_size) << " with data), "
+    << program_bytes_sent << " bytes to send at " << program_options.baudrate()
+    << " baud." << std::endl;
+  std::cout << "Predicted handshake:   " << prediction.handshake_seconds
+    << " s" << std::endl;
+  std::cout << "Predicted erase:       " << prediction.erase_seconds << " s"
+    << std::endl;
+  std::cout << "Predicted programming: " << prediction.program_seconds
+    << " s (" << model.ack_round_trip_seconds() * 1000.0
+    << " ms per acknowledgement)" << std::endl;
+  std::cout << "Predicted total:       " << prediction.total_seconds() << " s";
+  if (calibration_runs)
+    std::cout << " (calibrated from " << calibration_runs << " run(s))";
+  else
+    std::cout << " (uncalibrated)";
+  std::cout << std::endl;
+  return true;
+}
+
+// Measures the acknowledgement round trip time in the default and low-latency
+// serial modes, then leaves the port in the requested mode. Returns false if
+// the device stopped acknowledging.
+static bool CalibrateRoundTrip(MKComms &mk_comms, const bool low_latency)
+{
+  constexpr int kRequests = 20;
+  mk_comms.SetLowLatency(false);
+  const double default_rtt = mk_comms.MeasureRoundTrip(kRequests);
+  const bool supported = mk_comms.SetLowLatency(true);
+  const double low_latency_rtt = default_rtt < 0.0 ? -1.0
+    : mk_comms.MeasureRoundTrip(kRequests);
+  mk_comms.SetLowLatency(low_latency);
+
+  if (low_latency_rtt < 0.0)
+  {
+    std::cerr << "ERROR: Couldn't measure the acknowledgement round trip."
+      << std::endl;
+    return false;
+  }
+  std::cout << "Acknowledgement round trip: " << default_rtt * 1000.0
+    << " ms default, " << low_latency_rtt * 1000.0 << " ms low latency";
+  if (!supported)
+    std::cout << " (not supported by this port)";
+  std::cout << "." << std::endl;
+  return true;
+}
+
+// Reads the device's flash into the dump file.
+static bool Dump(const ProgramOptions &program_options, const MKComms &mk_comms)
+{
+  int size = MKComms::FlashSize(mk_comms.device_type());
+  if (program_options.dump_size() && (program_options.dump_size() < size))
+    size = program_options.dump_size();
+
+  FlashDump flash_dump(program_options.dump_filename());
+  if (!flash_dump)
+    return false;
+
+  const auto start = std::chrono::steady_clock::now();
+  const bool read = mk_comms.ReadProgram(size,
+    [&flash_dump](const uint8_t* const block, const int length) {
+      flash_dump.Write(block, length); });
+  if (!flash_dump.Close() || !read)
+    return false;
+  mk_comms.Exit();
+
+  std::cout << "Read " << size << " bytes in " << SecondsSince(start)
+    << " s, " << flash_dump.content_bytes() << " up to the end of the content."
+    << std::endl;
+  return true;
+}
+
+// Prints the digest of each image and makes sure that it matches the manifest
+// (if one was given).
+static bool CheckDigests(const std::vector<std::unique_ptr<IntelHex>> &images,
+  const std::vector<std::string> &image_digests,
+  const std::vector<std::string> &expected_digests)
+{
+  for (size_t i = 0; i < images.size(); ++i)
+  {
+    std::cout << "Image digest of " << images[i]->filename() << ": "
+      << image_digests[i] << std::endl;
+    if (!expected_digests.empty() && (image_digests[i] != expected_digests[i]))
+    {
+      std::cerr << "ERROR: " << images[i]->filename() << " does not match the"
+        << " manifest digest " << expected_digests[i] << "." << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Flashes the matching image onto each board of the inventory, up to jobs of
+// them at a time. Each line of output is prefixed with its port.
+static bool Batch(const ProgramOptions &program_options,
+  const Inventory &inventory,
+  const std::vector<std::unique_ptr<IntelHex>> &images)
+{
+  const std::vector<Inventory::Entry> &entries = inventory.entries();
+  std::mutex output_mutex;
+  std::atomic<size_t> next_entry(0);
+  std::atomic<int> flashed(0), failed(0);
+  std::vector<std::future<void>> workers;
+  const int worker_count = std::min<int>(std::max(program_options.jobs(), 1),
+    entries.size());
+  for (int i = 0; i < worker_count; ++i)
+  {
+    workers.push_back(std::async(std::launch::async, [&]() {
+      for (size_t j; (j = next_entry++) < entries.size(); )
+      {
+        const Inventory::Entry &entry = entries[j];
+        Log::ScopedSink sink([&](const bool error, const std::string &line) {
+          std::lock_guard<std::mutex> lock(output_mutex);
+          (error ? std::cerr : std::cout) << entry.serial_port << ": " << line
+            << std::endl; });
+
+        const IntelHex* hex = nullptr;
+        for (const std::unique_ptr<IntelHex> &image : images)
+          if (entry.responded && (MKComms::DeviceTypeForImage(
+            image->filename()) == entry.info.device_type))
+            hex = image.get();
+        if (!hex)
+        {
+          Log::Info() << "No image for this port, skipped." << std::endl;
+          continue;
+        }
+
+        Programmer programmer(entry.serial_port, program_options.baudrate());
+        programmer.set_verify(program_options.verify());
+        programmer.set_confirm_boot(program_options.confirm_boot());
+        programmer.mk_comms().set_compressed_transfer(
+          program_options.compress());
+        if (program_options.low_latency())
+          programmer.mk_comms().SetLowLatency(true);
+        RunStats stats;
+        stats.success = programmer && programmer.Connect(hex->filename(),
+          stats) && programmer.Flash(*hex, stats);
+        if (stats.success)
+          ++flashed;
+        else
+          ++failed;
+
+        std::lock_guard<std::mutex> lock(output_mutex);
+        if (!program_options.stats_filename().empty())
+          stats.Append(program_options.stats_filename());
+      }
+    }));
+  }
+  for (std::future<void> &worker : workers)
+    worker.wait();
+
+  std::cout << "Batch: " << flashed << " flashed, " << failed << " failed, "
+    << entries.size() - flashed - failed << " skipped." << std::endl;
+  return failed == 0;
+}
 
 int main (const int argc, const char* const argv[])
 {
@@ -11,28 +259,241 @@ int main (const int argc, const char* const argv[])
   if (!program_options)
     return 1;
 
-  // Open the hex file.
-  IntelHex hex(program_options.hex_filename());
-  if (!hex)
-    return 1;
+  // Render a previously recorded trace instead of programming.
+  if (!program_options.decode_trace_filename().empty())
+    return TraceDecoder::Print(program_options.decode_trace_filename(),
+      std::cout) ? 0 : 1;
+
+  if (program_options.list_ports())
+  {
+    for (const std::string &port : Serial::ListPorts())
+      std::cout << port << "\n";
+    return 0;
+  }
+
+  // Probe every port for a bootloader, without programming anything.
+  if (program_options.inventory())
+  {
+    constexpr int kInventoryTimeout = 1500;  // Milliseconds
+    Inventory inventory(Serial::ListPorts(), program_options.baudrate(),
+      kInventoryTimeout);
+    if (program_options.json())
+      inventory.PrintJSON(std::cout);
+    else
+      inventory.PrintTable(std::cout);
+    return 0;
+  }
+
+  const bool dump = !program_options.dump_filename().empty();
+  const bool batch = !program_options.batch_filename().empty();
+
+  // Open the hex files (unless the device's flash is to be read instead).
+  std::vector<std::unique_ptr<IntelHex>> images;
+  std::unique_ptr<IntelHex> combined;
+  IntelHex* hex = nullptr;
+  std::vector<std::string> expected_digests;
+  std::future<std::vector<std::string>> digests;
+  if (!dump)
+  {
+    images = LoadImages(program_options.hex_filenames(),
+      program_options.jobs());
+    for (const std::unique_ptr<IntelHex> &image : images)
+      if (!image || !*image)
+        return 1;
+
+    if (program_options.session() || batch)
+    {
+      // Each image goes to a different board, so they must not be combined.
+      std::vector<MKComms::DeviceType> device_types;
+      for (const std::unique_ptr<IntelHex> &image : images)
+      {
+        const MKComms::DeviceType device_type = MKComms::DeviceTypeForImage(
+          image->filename());
+        if (device_type == MKComms::DEVICE_TYPE_UNSUPPORTED)
+        {
+          std::cerr << "ERROR: Can't tell the device type from the name of "
+            << image->filename() << "." << std::endl;
+          return 1;
+        }
+        if (std::find(device_types.begin(), device_types.end(), device_type)
+          != device_types.end())
+        {
+          std::cerr << "ERROR: More than one image for the device type of "
+            << image->filename() << "." << std::endl;
+          return 1;
+        }
+        device_types.push_back(device_type);
+      }
+    }
+    else if (images.size() == 1)
+    {
+      hex = images[0].get();
+    }
+    else
+    {
+      if (!MKComms::SameDeviceType(program_options.hex_filenames()))
+        return 1;
+      std::vector<const IntelHex*> parts;
+      for (const std::unique_ptr<IntelHex> &image : images)
+        parts.push_back(image.get());
+      combined.reset(new IntelHex(parts));
+      if (!*combined)
+        return 1;
+      hex = combined.get();
+    }
+
+    if (program_options.dry_run())
+    {
+      // Print the digests that a --manifest would be checked against.
+      for (const std::unique_ptr<IntelHex> &image : images)
+        std::cout << "Image digest of " << image->filename() << ": "
+          << image->Digest() << std::endl;
+      if (hex)
+        return DryRun(program_options, *hex) ? 0 : 1;
+      for (const std::unique_ptr<IntelHex> &image : images)
+        if (!DryRun(program_options, *image))
+          return 1;
+      return 0;
+    }
+
+    // Look up the expected digest of each file, if a manifest was given.
+    if (!program_options.manifest_filename().empty())
+    {
+      Manifest manifest(program_options.manifest_filename());
+      if (!manifest)
+        return 1;
+      for (const std::unique_ptr<IntelHex> &image : images)
+      {
+        expected_digests.push_back(manifest.Digest(image->filename()));
+        if (expected_digests.back().empty())
+        {
+          std::cerr << "ERROR: " << program_options.manifest_filename()
+            << " has no entry for " << image->filename() << "." << std::endl;
+          return 1;
+        }
+      }
+    }
+
+    // Hash the files in the background while waiting for the bootloader.
+    digests = std::async(std::launch::async, [&images]() {
+      std::vector<std::future<std::string>> file_digests;
+      for (const std::unique_ptr<IntelHex> &image : images)
+      {
+        const IntelHex* const file = image.get();
+        file_digests.push_back(std::async(std::launch::async,
+          [file]() { return file->Digest(); }));
+      }
+      std::vector<std::string> result;
+      for (std::future<std::string> &file_digest : file_digests)
+        result.push_back(file_digest.get());
+      return result;
+    });
+  }
+
+  if (batch)
+  {
+    Inventory inventory(program_options.batch_filename());
+    if (!inventory)
+      return 1;
+    // Make sure the images are intact before anything is erased.
+    if (!CheckDigests(images, digests.get(), expected_digests))
+      return 1;
+    return Batch(program_options, inventory, images) ? 0 : 1;
+  }
+
+  // The name that the board is matched against. For combined files this is
+  // "a + b", so any part may name the device type.
+  const std::string image_filename = hex ? hex->filename()
+    : program_options.hex_filename();
+
+  // Optionally stand in a simulated bootloader for the serial port.
+  std::string serial_port = program_options.serial_port();
+  std::unique_ptr<MKSimulator> simulator;
+  if (program_options.simulate())
+  {
+    const MKComms::DeviceType device_type = MKComms::DeviceTypeForImage(
+      image_filename);
+    MKComms::FirmwareVersion firmware_version = MKComms::FirmwareVersion();
+    MKComms::FirmwareVersionForImage(image_filename, firmware_version);
+    simulator.reset(new MKSimulator(device_type,
+      MKComms::DefaultProgramBlockSize(device_type),
+      program_options.baudrate(), firmware_version));
+    if (!*simulator)
+      return 1;
+    serial_port = simulator->port_name();
+  }
+
+  // Or play back the device side of a recorded session.
+  std::unique_ptr<TraceReplay> replay;
+  if (!program_options.replay_filename().empty())
+  {
+    replay.reset(new TraceReplay(program_options.replay_filename(),
+      program_options.replay_speed()));
+    if (!*replay)
+      return 1;
+    serial_port = replay->port_name();
+  }
+
+  // Optionally record all serial traffic. This is declared before programmer
+  // so that it is destroyed after it, outliving every use by the port.
+  std::unique_ptr<SerialTrace> trace;
+  if (!program_options.trace_filename().empty())
+  {
+    trace.reset(new SerialTrace(program_options.trace_filename()));
+    if (!*trace)
+      return 1;
+  }
 
   // Open serial communications with a MikroKopter device (bootloader).
-  MKComms mk_comms(program_options.serial_port());
-  if (!mk_comms)
+  Programmer programmer(serial_port, program_options.baudrate());
+  if (!programmer)
     return 1;
+  programmer.set_verify(program_options.verify());
+  programmer.set_confirm_boot(program_options.confirm_boot());
+  MKComms &mk_comms = programmer.mk_comms();
+  if (trace)
+    mk_comms.set_trace(trace.get());
+  mk_comms.set_compressed_transfer(program_options.compress());
+  if (program_options.low_latency() && !mk_comms.SetLowLatency(true))
+    std::cout << "Low-latency mode is not supported by " << serial_port << "."
+      << std::endl;
 
-  if (!mk_comms.RequestBLComms(program_options.hex_filename()))
-    return 1;
+  if (dump)
+  {
+    if (!mk_comms.RequestBLComms(""))
+      return 1;
+    return Dump(program_options, mk_comms) ? 0 : 1;
+  }
 
-  // Clear the flash memory.
-  if (!mk_comms.RequestClearFlash(hex.size()))
-    return 1;
+  if (program_options.session())
+  {
+    // Make sure the images are intact before anything is erased.
+    if (!CheckDigests(images, digests.get(), expected_digests))
+      return 1;
+    std::vector<const IntelHex*> boards;
+    for (const std::unique_ptr<IntelHex> &image : images)
+      boards.push_back(image.get());
+    return programmer.FlashSession(boards, [&](const RunStats &stats) {
+      if (!program_options.stats_filename().empty())
+        stats.Append(program_options.stats_filename()); }) ? 0 : 1;
+  }
 
-  // Send the contents of the hex file to the device.
-  if (!mk_comms.SendProgram(hex.program(), hex.size()))
-    return 1;
+  RunStats stats;
+  stats.image_bytes = hex->size();
+  if (!programmer.Connect(image_filename, stats))
+    return Finish(program_options, stats, false);
 
-  mk_comms.Exit();
+  if (program_options.calibrate_rtt()
+    && !CalibrateRoundTrip(mk_comms, program_options.low_latency()))
+    return Finish(program_options, stats, false);
+
+  // Make sure the image is intact before anything is erased. If it isn't, the
+  // board's flash still is, so let it go back to its program.
+  if (!CheckDigests(images, digests.get(), expected_digests))
+  {
+    mk_comms.Exit();
+    return Finish(program_options, stats, false);
+  }
 
-  return 0;
+  return Finish(program_options, stats, programmer.Flash(*hex, stats));
 }
@@ -0,0 +1,70 @@
+#include "manifest.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "log.hpp"
+
+static std::string BaseName(const std::string &filename)
+{
+  const size_t slash = filename.find_last_of('/');
+  return slash == std::string::npos ? filename : filename.substr(slash + 1);
+}
+
+Manifest::Manifest(const std::string &manifest_filename)
+{
+  std::ifstream manifest_file(manifest_filename);
+  if (!manifest_file)
+  {
+    Log::Error() << "ERROR: Couldn't open " << manifest_filename << std::endl;
+    return;
+  }
+
+  std::string line;
+  int line_number = 0;
+  while (std::getline(manifest_file, line))
+  {
+    ++line_number;
+    std::istringstream line_stream(line);
+    std::string digest, filename;
+    if (!(line_stream >> digest))
+      continue;  // Blank line.
+    line_stream >> filename;
+
+    std::transform(digest.begin(), digest.end(), digest.begin(), ::tolower);
+    if ((digest.length() != 64) || (digest.find_first_not_of(
+      "0123456789abcdef") != std::string::npos))
+    {
+      Log::Error() << "ERROR: Can't interpret text at " << manifest_filename
+        << ": " << line_number << "." << std::endl;
+      digests_.clear();
+      return;
+    }
+
+    // sha256sum marks binary-mode entries with a leading '*'.
+    if (!filename.empty() && filename[0] == '*')
+      filename.erase(0, 1);
+    digests_[BaseName(filename)] = digest;
+  }
+
+  if (digests_.empty())
+    Log::Error() << "ERROR: " << manifest_filename << " contains no digests."
+      << std::endl;
+}
+
+std::string Manifest::Digest(const std::string &image_filename) const
+{
+  auto it = digests_.find(BaseName(image_filename));
+  if (it != digests_.end())
+    return it->second;
+
+  // A manifest with a single unnamed entry applies to any image.
+  it = digests_.find("");
+  if ((digests_.size() == 1) && (it != digests_.end()))
+    return it->second;
+
+  return std::string();
+}
@@ -0,0 +1,28 @@
+#ifndef MANIFEST_H_
+#define MANIFEST_H_
+
+#include <map>
+#include <string>
+
+// Reads a list of expected image digests, one "<digest>  <filename>" entry per
+// line as in sha256sum's output. The digests are those of IntelHex::Digest(),
+// i.e. of the parsed image rather than of the hex file's text, so take them
+// from the output of --dry-run rather than from sha256sum.
+class Manifest
+{
+public:
+  Manifest(const std::string &manifest_filename);
+
+  operator bool() const { return !digests_.empty(); }
+
+  // Returns the expected digest for the named image (matched by its base name),
+  // or an empty string if the manifest has no entry for it.
+  std::string Digest(const std::string &image_filename) const;
+
+private:
+  Manifest();
+
+  std::map<std::string, std::string> digests_;
+};
+
+#endif // MANIFEST_H_
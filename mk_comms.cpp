@@ -3,135 +3,171 @@
 
 #include "mk_comms.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <thread>
 
 #include "crc16.hpp"
+#include "log.hpp"
+#include "mk_frame.hpp"
+#include "rle.hpp"
+
+// Asks whether the bootloader accepts run-length compressed program blocks
+// (memory type 'Z' in the block load command), answered with 'Y'. Bootloaders
+// that don't know the command answer '?' without reading anything more, so
+// asking is safe, whereas sending them a 'Z' block is not: they would reject
+// its header and then take the payload for commands.
+static constexpr uint8_t kCompressionQueryCommand = 'z';
+
+// Application protocol commands: the NaviCtrl's redirect, and a version
+// request and its answer.
+static constexpr uint8_t kRedirectCommand = 'u';
+static constexpr uint8_t kVersionRequestCommand = 'v';
+static constexpr uint8_t kVersionCommand = 'V';
+
+// Response timeouts (in seconds) before the first response of a type has been
+// timed. Clearing is timed per byte and the initial rate allows about three
+// times the usual rate.
+static constexpr double kInitialResponseTimeout = 1.0;
+static constexpr double kInitialClearTimeoutPerByte = 5e-5;
+// Bounds on the estimated part of any response timeout, in seconds. As in
+// RFC 6298 the floor is 1 s: requests are never retransmitted, so a response
+// that arrives after the timeout fails the whole run. That leaves the
+// estimate to decide only the timeouts of slow responses, mainly clearing the
+// flash (timed per byte), and block loads and reads on devices that take
+// longer than the floor to write or fetch a block. Quick requests always get
+// the floor.
+static constexpr double kMinResponseTimeout = 1.0;
+static constexpr double kMaxResponseTimeout = 120.0;
+
+// Names of the MKComms::RequestType values for error messages.
+static const char* const kRequestNames[] = {
+  "Signature",
+  "Set device",
+  "Bootloader version",
+  "Program block size",
+  "Set clear size",
+  "Clear flash",
+  "Set address",
+  "Block programming",
+  "Block read",
+  "Compression support",
+};
 
 // ============================================================================+
 // Public functions:
 
-bool MKComms::RequestBLComms(const std::string &hex_filename)
+bool MKComms::RequestRedirect(const RedirectTarget target) const
 {
-  bool responded = false;
-
-  std::cout << "Sending device reset request." << std::endl;
-
-  RequestDeviceReset();
+  Log::Info() << "Requesting NaviCtrl redirect to the "
+    << (target == REDIRECT_TARGET_FLIGHTCTRL ? "FlightCtrl." : "MK3Mag.")
+    << std::endl;
+  const uint8_t data[1] = { (uint8_t)target };
+  if (SendFrame(ADDRESS_NAVICTRL, kRedirectCommand, data, sizeof(data)) < 1)
+    return false;
+  // Give the NaviCtrl a moment to switch over before the reset request.
   std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  return true;
+}
 
-  std::cout << "Waiting for MikroKopter bootloader." << std::flush;
+bool MKComms::EndRedirect() const
+{
+  // The NaviCtrl watches redirected traffic for this sequence.
+  const uint8_t magic_packet[5] = { 0x1B, 0x1B, 0x55, 0xAA, 0x00 };
+  return serial_.SendBuffer(magic_packet, sizeof(magic_packet))
+    == sizeof(magic_packet);
+}
 
-  // Begin sending requests for bootloader comms.
-  for (int seconds = 0; !responded && (seconds < 10); ++seconds)
+bool MKComms::RequestBLComms(const std::string &hex_filename)
+{
+  constexpr int kBootloaderTimeout = 10000;  // Milliseconds
+  if (!WaitForBootloader(kBootloaderTimeout))
   {
-    constexpr int kPingFrequency = 10;  // Hz
-    constexpr int kPingDuration = 1;  // Seconds
-    for (int i = 0; !responded && (i < kPingFrequency * kPingDuration); ++i)
+    if (!cancelled_)
     {
-      serial_.SendByte(0x1B);
-      std::this_thread::sleep_for(std::chrono::milliseconds(20));
-      serial_.SendByte(0xAA);
-      std::this_thread::sleep_for(std::chrono::milliseconds(80));
-      const uint8_t bootloader_init_string[4] = { 'M', 'K', 'B', 'L' };
-      responded = CheckResponse(bootloader_init_string, 4);
+      Log::Error() << "ERROR: No response from the Mikrokopter device.\n";
+      Log::Error() << "Try removing power from the device then reapply power"
+        << " once this program starts waiting for the bootloader."
+        << std::endl;
     }
-    std::cout << "." << std::flush;
-  }
-  std::cout << std::endl;
-
-  if (!responded)
-  {
-    std::cerr << "ERROR: No response from the Mikrokopter device.\n";
-    std::cerr << "Try removing power from the device then reapply power once"
-      << " this program starts waiting for the bootloader." << std::endl;
     return false;
   }
 
-  // Read the device signature.
-  serial_.SendByte('t');
-  uint8_t signature[2];
-  if (!GetResponse(signature, 2, 2, "Signature"))
+  // Read and process the device signature.
+  uint8_t signature;
+  if (!RequestSignature(signature))
     return false;
-
-  // Process the device signature.
-  bool device_match;
-  switch (signature[0])
+  const std::string board_name = BoardName(static_cast<DeviceType>(signature));
+  if (board_name.empty())
   {
-    case DEVICE_TYPE_MEGA644:
-      device_match = (hex_filename.find("MEGA644") != std::string::npos);
-      std::cout << "FlightCtrl w/ ATMega644" << std::endl;
-      break;
-    case DEVICE_TYPE_MEGA1284:
-      device_match = (hex_filename.find("MEGA1284") != std::string::npos);
-      std::cout << "FlightCtrl w/ ATMega1284" << std::endl;
-      break;
-    case DEVICE_TYPE_STR911:
-      device_match = (hex_filename.find("STR9") != std::string::npos);
-      std::cout << "NaviCtrl w/ STR911" << std::endl;
-      break;
-    default:
-      std::cerr << "ERROR: Unsupported device." << std::endl;
-      return false;
-      break;
+    Log::Error() << "ERROR: Unsupported device." << std::endl;
+    return false;
   }
-  if (!device_match)
+  Log::Info() << board_name << std::endl;
+
+  // An empty filename accepts any supported device (e.g. to read it).
+  if (!hex_filename.empty() && (DeviceTypeForImage(hex_filename) != signature))
   {
-    std::cerr << "ERROR: Hex file and device mismatch." << std::endl;
+    Log::Error() << "ERROR: Hex file and device mismatch." << std::endl;
     return false;
   }
-  device_type_ = static_cast<DeviceType>(signature[0]);
+  device_type_ = static_cast<DeviceType>(signature);
 
   // Set the device.
   serial_.SendByte('T');
-  serial_.SendByte(signature[0]);
+  serial_.SendByte(signature);
   uint8_t okay[1];
-  if (!GetResponse(okay, 1, 1, "Set device"))
+  if (!GetResponse(okay, 1, 1, REQUEST_SET_DEVICE))
     return false;
   if (okay[0] != 0x0D)
   {
-    std::cerr << "ERROR: Device did not accept request to set device type."
+    Log::Error() << "ERROR: Device did not accept request to set device type."
       << std::endl;
     return false;
   }
 
   // Read the bootloader version.
-  serial_.SendByte('V');
-  uint8_t version[3];
-  int version_length = GetResponse(version, 2, 3, "Bootloader version");
-  if (version_length == 2)
-    std::cout << "MikroKopter bootloader V" << version[0] << "." << version[1]
-      << std::endl;
-  else if (version_length == 3)
-    std::cout << "MikroKopter bootloader V" << version[0] << "." << version[1]
-      << version[2] << std::endl;
-  else
+  std::string version;
+  if (!RequestVersion(version))
     return false;
+  Log::Info() << "MikroKopter bootloader V" << version << std::endl;
 
-  // Read the devices programming block size.
-  serial_.SendByte('b');
-  uint8_t program_block_size[3];
-  if (!GetResponse(program_block_size, 3, 3, "Program block size"))
-    return false;
-  if (program_block_size[0] != 'Y')
+  compressed_transfer_ = false;
+  if (compressed_transfer_requested_)
   {
-    std::cerr << "ERROR: Unexpected response to request for program block size."
+    if (!RequestCompressionSupport(compressed_transfer_))
+      return false;
+    Log::Info() << "Compressed transfer "
+      << (compressed_transfer_ ? "enabled." : "not supported by bootloader.")
       << std::endl;
-    return false;
   }
-  program_block_size_ = (program_block_size[1] << 8) | program_block_size[2];
-  std::cout << "Program block size: " << program_block_size_ << std::endl;
 
-  if (program_block_size_ < 1)
-  {
-    std::cerr << "ERROR: Unexpected program block size." << std::endl;
+  // Read the devices programming block size.
+  if (!RequestProgramBlockSize(program_block_size_))
     return false;
-  }
+  encoded_block_.resize(RLE::MaxEncodedSize(program_block_size_));
+  Log::Info() << "Program block size: " << program_block_size_ << std::endl;
 
   return true;
 }
 
+bool MKComms::Identify(const int timeout_ms, BootloaderInfo &info)
+{
+  if (!WaitForBootloader(timeout_ms))
+    return false;
+
+  uint8_t signature;
+  if (!RequestSignature(signature) || !RequestVersion(info.version)
+    || !RequestProgramBlockSize(info.program_block_size))
+    return false;
+  info.device_type = signature;
+
+  // Leave the bootloader so that the device goes back to its program.
+  return Exit();
+}
+
 bool MKComms::RequestClearFlash(const int bytes_to_clear) const
 {
   if (device_type_ == DEVICE_TYPE_STR911)
@@ -144,34 +180,38 @@ bool MKComms::RequestClearFlash(const int bytes_to_clear) const
     };
     serial_.SendBuffer(header, sizeof(header));
     uint8_t okay[1];
-    if (!GetResponse(okay, 1, 1, "Set clear size"))
+    if (!GetResponse(okay, 1, 1, REQUEST_SET_CLEAR_SIZE))
       return false;
     if (okay[0] != 0x0D)
     {
-      std::cerr << "ERROR: Device did not accept request to set clear size."
+      Log::Error() << "ERROR: Device did not accept request to set clear size."
         << std::endl;
       return false;
     }
-    std::cout << "Requesting " << bytes_to_clear << " bytes to be cleared."
+    Log::Info() << "Requesting " << bytes_to_clear << " bytes to be cleared."
       << std::endl;
   }
 
   serial_.SendByte('e');
   uint8_t okay[1];
-  if (!GetResponse(okay, 1, 1, "Clear flash"))
+  if (!GetResponse(okay, 1, 1, REQUEST_CLEAR_FLASH, 0,
+    BytesCleared(device_type_, bytes_to_clear)))
     return false;
   if (okay[0] != 0x0D)
   {
-    std::cerr << "ERROR: Device did not accept request to clear flash."
+    Log::Error() << "ERROR: Device did not accept request to clear flash."
       << std::endl;
     return false;
   }
-  std::cout << " done" << std::endl;
+  Log::Info() << " done" << std::endl;
   return true;
 }
 
 bool MKComms::SendProgram(const uint8_t* const program, const int size) const
 {
+  // Count only this image's bytes, however often the port has been used.
+  program_bytes_sent_ = 0;
+
   // Start programming from address 0x0000
   // NOTE: MikroKopter Tool starts programming from the second block so this
   // may need to be changed to match that in the future.
@@ -183,25 +223,364 @@ bool MKComms::SendProgram(const uint8_t* const program, const int size) const
 
   for (int i = 0; i < block_count; ++i)
   {
-    std::cout << "Programming block " << i + 1 << " of " << block_count << "."
+    Log::Info() << "Programming block " << i + 1 << " of " << block_count << "."
       << std::endl;
     if (!SendProgramBlock(program + i * program_block_size_))
     {
       return false;
     }
+    if (progress_handler_)
+      progress_handler_(i + 1, block_count);
   }
   return true;
 }
 
+bool MKComms::ReadProgram(const int size, const std::function<void (
+  const uint8_t* const block, const int length)> &block_handler) const
+{
+  if (!RequestAddress(0x0000))
+    return false;
+
+  const int block_count = (size - 1) / program_block_size_ + 1;
+  std::vector<uint8_t> block(program_block_size_);
+  for (int i = 0; i < block_count; ++i)
+  {
+    Log::Info() << "Reading block " << i + 1 << " of " << block_count << "."
+      << std::endl;
+    if (!ReadProgramBlock(block.data()))
+      return false;
+    block_handler(block.data(), std::min(program_block_size_,
+      size - i * program_block_size_));
+    if (progress_handler_)
+      progress_handler_(i + 1, block_count);
+  }
+  return true;
+}
+
+bool MKComms::VerifyProgram(const uint8_t* const program, const int size) const
+{
+  int offset = 0, mismatch = -1;
+  const bool read = ReadProgram(size,
+    [&](const uint8_t* const block, const int length) {
+      for (int i = 0; (mismatch < 0) && (i < length); ++i)
+        if (block[i] != program[offset + i])
+          mismatch = offset + i;
+      offset += length;
+    });
+  if (!read)
+    return false;
+
+  if (mismatch >= 0)
+  {
+    Log::Error() << "ERROR: Verification failed at address 0x" << std::hex
+      << mismatch << std::dec << "." << std::endl;
+    return false;
+  }
+  Log::Info() << "Verified " << size << " bytes." << std::endl;
+  return true;
+}
+
+double MKComms::MeasureRoundTrip(const int requests) const
+{
+  double total_seconds = 0.0;
+  for (int i = 0; i < requests; ++i)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    if (!RequestAddress(0x0000))
+      return -1.0;
+    total_seconds += SecondsSince(start);
+  }
+  return total_seconds / requests;
+}
+
 bool MKComms::Exit() const
 {
-  serial_.SendByte('E');
+  return serial_.SendByte('E') == 1;
 }
 
+bool MKComms::RequestFirmwareVersion(const Address address,
+  const int timeout_ms, FirmwareVersion &version) const
+{
+  // The program ignores requests until it has started, so the request is
+  // repeated whenever nothing has been heard for a while.
+  constexpr int kRequestInterval = 200;  // Milliseconds
+  constexpr int kCancelCheckInterval = 100;  // Milliseconds
+  const auto deadline = std::chrono::steady_clock::now()
+    + std::chrono::milliseconds(timeout_ms);
+  auto next_request = std::chrono::steady_clock::now();
+  std::vector<uint8_t> frame, data;
+  for (;;)
+  {
+    const auto now = std::chrono::steady_clock::now();
+    if (cancelled_)
+    {
+      Log::Error() << "ERROR: Cancelled." << std::endl;
+      return false;
+    }
+    if (now >= deadline)
+      return false;
+    if (now >= next_request)
+    {
+      SendFrame(address, kVersionRequestCommand, nullptr, 0);
+      next_request = now + std::chrono::milliseconds(kRequestInterval);
+    }
+
+    const int timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::min(deadline, next_request) - now).count();
+    if (!serial_.WaitForData(std::min(timeout + 1, kCancelCheckInterval)))
+      continue;
+    uint8_t rx_buffer[255];
+    const int rx_bytes_read = serial_.Read(rx_buffer, sizeof(rx_buffer));
+    for (int i = 0; i < rx_bytes_read; ++i)
+    {
+      // Collect frames, skipping anything between them.
+      if (rx_buffer[i] == '#')
+        frame.clear();
+      else if (frame.empty())
+        continue;
+      frame.push_back(rx_buffer[i]);
+      if (rx_buffer[i] != '\r')
+        continue;
+
+      int frame_address;
+      uint8_t command;
+      const bool decoded = MKFrame::Decode(frame.data(), frame.size(),
+        frame_address, command, data);
+      frame.clear();
+      // SWMajor, SWMinor, ProtoMajor, ProtoMinor, SWPatch, ...
+      if (decoded && (frame_address == address) && (command
+        == kVersionCommand) && (data.size() >= 5))
+      {
+        version.major = data[0];
+        version.minor = data[1];
+        version.patch = data[4];
+        return true;
+      }
+    }
+  }
+}
+
+MKComms::DeviceType MKComms::DeviceTypeForImage(const std::string &hex_filename)
+{
+  if (hex_filename.find("MEGA644") != std::string::npos)
+    return DEVICE_TYPE_MEGA644;
+  if (hex_filename.find("MEGA1284") != std::string::npos)
+    return DEVICE_TYPE_MEGA1284;
+  if (hex_filename.find("STR9") != std::string::npos)
+    return DEVICE_TYPE_STR911;
+  return DEVICE_TYPE_UNSUPPORTED;
+}
+
+bool MKComms::SameDeviceType(const std::vector<std::string> &hex_filenames)
+{
+  const std::string* typed_filename = nullptr;
+  for (const std::string &hex_filename : hex_filenames)
+  {
+    const DeviceType device_type = DeviceTypeForImage(hex_filename);
+    if (device_type == DEVICE_TYPE_UNSUPPORTED)
+      continue;
+    if (typed_filename && (device_type != DeviceTypeForImage(*typed_filename)))
+    {
+      Log::Error() << "ERROR: " << hex_filename << " and " << *typed_filename
+        << " are for different device types and can't be combined."
+        << std::endl;
+      return false;
+    }
+    typed_filename = &hex_filename;
+  }
+  return true;
+}
+
+std::string MKComms::BoardName(const DeviceType device_type)
+{
+  switch (device_type)
+  {
+    case DEVICE_TYPE_MEGA644:
+      return "FlightCtrl w/ ATMega644";
+    case DEVICE_TYPE_MEGA1284:
+      return "FlightCtrl w/ ATMega1284";
+    case DEVICE_TYPE_STR911:
+      return "NaviCtrl w/ STR911";
+    default:
+      return "";
+  }
+}
+
+MKComms::Address MKComms::AddressOf(const DeviceType device_type)
+{
+  return device_type == DEVICE_TYPE_STR911 ? ADDRESS_NAVICTRL
+    : ADDRESS_FLIGHTCTRL;
+}
+
+bool MKComms::FirmwareVersionForImage(const std::string &hex_filename,
+  FirmwareVersion &version)
+{
+  // e.g. "Flight-Ctrl_MEGA644p_V0_88n.hex" is V0.88n.
+  for (size_t v = hex_filename.find("_V"); v != std::string::npos;
+    v = hex_filename.find("_V", v + 1))
+  {
+    int major, minor, length = 0;
+    char patch = 'a';
+    if (std::sscanf(hex_filename.c_str() + v, "_V%d_%d%n", &major, &minor,
+      &length) < 2)
+      continue;
+    const char next = hex_filename[v + length];
+    if ((next >= 'a') && (next <= 'z'))
+      patch = next;
+    version.major = major;
+    version.minor = minor;
+    version.patch = patch - 'a';
+    return true;
+  }
+  return false;
+}
+
+std::string MKComms::FirmwareVersionString(const FirmwareVersion &version)
+{
+  char text[16];
+  std::snprintf(text, sizeof(text), "V%d.%02d%c", version.major,
+    version.minor, 'a' + version.patch);
+  return text;
+}
+
+int MKComms::FlashSize(const DeviceType device_type)
+{
+  switch (device_type)
+  {
+    case DEVICE_TYPE_MEGA644:
+      return 64 * 1024;
+    case DEVICE_TYPE_MEGA1284:
+      return 128 * 1024;
+    case DEVICE_TYPE_STR911:
+      return 512 * 1024;
+    default:
+      return 0;
+  }
+}
+
+int MKComms::BytesCleared(const DeviceType device_type,
+  const int bytes_to_clear)
+{
+  // AVR bootloaders clear the whole flash, the STR911's clears the given size.
+  if ((device_type != DEVICE_TYPE_STR911) && FlashSize(device_type))
+    return FlashSize(device_type);
+  return bytes_to_clear;
+}
+
+int MKComms::DefaultProgramBlockSize(const DeviceType device_type)
+{
+  return device_type == DEVICE_TYPE_STR911 ? 2048 : 256;
+}
+
+int MKComms::BlockPayloadSize(const uint8_t* const block,
+  const int program_block_size, const bool compressed_transfer)
+{
+  if (!compressed_transfer)
+    return program_block_size;
+  return std::min(RLE::EncodedSize(block, program_block_size),
+    program_block_size);
+}
 
 // ============================================================================+
 // Private  functions:
 
+bool MKComms::WaitForBootloader(const int timeout_ms)
+{
+  Log::Info() << "Sending device reset request." << std::endl;
+
+  // Until the device identifies itself, time its responses apart from those
+  // of any known device type.
+  device_type_ = DEVICE_TYPE_UNSUPPORTED;
+  RequestDeviceReset();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  Log::Info() << "Waiting for MikroKopter bootloader." << std::flush;
+
+  // Begin sending requests for bootloader comms.
+  constexpr int kPingPeriod = 100;  // Milliseconds
+  constexpr int kPingsPerDot = 10;
+  bool responded = false;
+  for (int i = 0; !responded && (i < timeout_ms / kPingPeriod); ++i)
+  {
+    if (cancelled_)
+    {
+      Log::Info() << std::endl;
+      Log::Error() << "ERROR: Cancelled." << std::endl;
+      return false;
+    }
+    serial_.SendByte(0x1B);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    serial_.SendByte(0xAA);
+    std::this_thread::sleep_for(std::chrono::milliseconds(kPingPeriod - 20));
+    const uint8_t bootloader_init_string[4] = { 'M', 'K', 'B', 'L' };
+    responded = CheckResponse(bootloader_init_string, 4);
+    if ((i + 1) % kPingsPerDot == 0)
+      Log::Info() << "." << std::flush;
+  }
+  Log::Info() << std::endl;
+  return responded;
+}
+
+bool MKComms::RequestSignature(uint8_t &signature) const
+{
+  serial_.SendByte('t');
+  uint8_t response[2];
+  if (!GetResponse(response, 2, 2, REQUEST_SIGNATURE))
+    return false;
+  signature = response[0];
+  return true;
+}
+
+bool MKComms::RequestVersion(std::string &version) const
+{
+  serial_.SendByte('V');
+  uint8_t response[3];
+  const int length = GetResponse(response, 2, 3, REQUEST_VERSION);
+  if (!length)
+    return false;
+  // e.g. "30" is V3.0 and "301" is V3.01.
+  version = std::string(1, response[0]) + "."
+    + std::string(response + 1, response + length);
+  return true;
+}
+
+bool MKComms::RequestCompressionSupport(bool &supported) const
+{
+  serial_.SendByte(kCompressionQueryCommand);
+  uint8_t response[1];
+  if (!GetResponse(response, 1, 1, REQUEST_COMPRESSION))
+    return false;
+  if ((response[0] != 'Y') && (response[0] != '?'))
+  {
+    Log::Error() << "ERROR: Unexpected response to request for compression"
+      << " support." << std::endl;
+    return false;
+  }
+  supported = response[0] == 'Y';
+  return true;
+}
+
+bool MKComms::RequestProgramBlockSize(int &program_block_size) const
+{
+  serial_.SendByte('b');
+  uint8_t response[3];
+  if (!GetResponse(response, 3, 3, REQUEST_PROGRAM_BLOCK_SIZE))
+    return false;
+  if (response[0] != 'Y')
+  {
+    Log::Error() << "ERROR: Unexpected response to request for program block"
+      << " size." << std::endl;
+    return false;
+  }
+  program_block_size = (response[1] << 8) | response[2];
+  if (program_block_size < 1)
+  {
+    Log::Error() << "ERROR: Unexpected program block size." << std::endl;
+    return false;
+  }
+  return true;
+}
+
 bool MKComms::RequestAddress(const int address) const
 {
   uint8_t header[3] = {
@@ -211,11 +590,11 @@ bool MKComms::RequestAddress(const int address) const
   };
   serial_.SendBuffer(header, sizeof(header));
   uint8_t okay[1];
-  if (!GetResponse(okay, 1, 1, "Set address"))
+  if (!GetResponse(okay, 1, 1, REQUEST_SET_ADDRESS))
     return false;
   if (okay[0] != 0x0D)
   {
-    std::cerr << "ERROR: Device did not accept request to set address."
+    Log::Error() << "ERROR: Device did not accept request to set address."
       << std::endl;
     return false;
   }
@@ -224,16 +603,32 @@ bool MKComms::RequestAddress(const int address) const
 
 bool MKComms::SendProgramBlock(const uint8_t* const block) const
 {
+  // Send the block run-length encoded only when that actually saves bytes
+  // (e.g. padding or erased regions), otherwise send it as is.
+  const uint8_t* payload = block;
+  int payload_size = program_block_size_;
+  uint8_t memory_type = 'F';
+  if (BlockPayloadSize(block, program_block_size_, compressed_transfer_)
+    < program_block_size_)
+  {
+    payload = encoded_block_.data();
+    payload_size = RLE::Encode(block, program_block_size_,
+      encoded_block_.data());
+    memory_type = 'Z';
+  }
+
   uint8_t header[4] = {
     'B',
-    (uint8_t)((program_block_size_ >> 8) & 0xFF),
-    (uint8_t)(program_block_size_ & 0xFF),
-    'F'
+    (uint8_t)((payload_size >> 8) & 0xFF),
+    (uint8_t)(payload_size & 0xFF),
+    memory_type
   };
   serial_.SendBuffer(header, sizeof(header));
 
-  serial_.SendBuffer(block, program_block_size_);
+  serial_.SendBuffer(payload, payload_size);
+  program_bytes_sent_ += kBlockLoadOverheadBytes + payload_size;
 
+  // Note that the CRC always covers the uncompressed block.
   CRC16 crc;
   for (int i = 0; i < program_block_size_; ++i)
   {
@@ -245,17 +640,31 @@ bool MKComms::SendProgramBlock(const uint8_t* const block) const
   crc_buffer[1] = crc.result() & 0xFF;
   serial_.SendBuffer(crc_buffer, sizeof(crc_buffer)) > 0;
   uint8_t okay[1];
-  if (!GetResponse(okay, 1, 1, "Block programming"))
+  if (!GetResponse(okay, 1, 1, REQUEST_BLOCK_LOAD, sizeof(header)
+    + payload_size + sizeof(crc_buffer)))
     return false;
   if (okay[0] != 0x0D)
   {
-    std::cerr << "ERROR: Device responded to CRC with " << (int)okay[0]
+    Log::Error() << "ERROR: Device responded to CRC with " << (int)okay[0]
       << std::endl;
     return false;
   }
   return true;
 }
 
+bool MKComms::ReadProgramBlock(uint8_t* const block) const
+{
+  uint8_t header[4] = {
+    'g',
+    (uint8_t)((program_block_size_ >> 8) & 0xFF),
+    (uint8_t)(program_block_size_ & 0xFF),
+    'F'
+  };
+  serial_.SendBuffer(header, sizeof(header));
+  return GetResponse(block, program_block_size_, program_block_size_,
+    REQUEST_BLOCK_READ, sizeof(header)) != 0;
+}
+
 int MKComms::RequestDeviceReset() const
 {
   // Message contains: sync char "#", address 0 + "a" = "a", reset command "R",
@@ -264,6 +673,14 @@ int MKComms::RequestDeviceReset() const
   return serial_.SendBuffer(reset_request, sizeof(reset_request));
 }
 
+int MKComms::SendFrame(const int address, const uint8_t command,
+  const uint8_t* const data, const int length) const
+{
+  const std::vector<uint8_t> frame = MKFrame::Encode(address, command, data,
+    length);
+  return serial_.SendBuffer(frame.data(), frame.size());
+}
+
 bool MKComms::CheckResponse(const uint8_t* const expected_response,
   const int expected_response_length)
 {
@@ -291,21 +708,50 @@ bool MKComms::CheckResponse(const uint8_t* const expected_response,
 }
 
 int MKComms::GetResponse(uint8_t* const response, const int min_response_length,
-  const int max_response_length, const std::string &request_string) const
+  const int max_response_length, const RequestType request_type,
+  const int tx_bytes, const int work) const
 {
   constexpr int kBufferSize = 255;
   uint8_t rx_buffer[kBufferSize];
   int rx_bytes_read, total_bytes_read = 0;
 
-  // Poll the serial port.
-  constexpr int kPollingDuration = 5;  // Seconds
-  constexpr int kPollingFrequency = 100;  // Hz
-  for (int i = kPollingFrequency * kPollingDuration;
-    (total_bytes_read < min_response_length) && i--; )
+  // Time on the wire is known from the baudrate (10 bits per byte), so only
+  // the rest of the response time is estimated.
+  ResponseTimer &response_timer = ResponseTimers()[request_type];
+  const double wire_time = (tx_bytes + max_response_length) * 10.0
+    / baudrate_;
+  const double timeout_seconds = wire_time + std::min(std::max(
+    response_timer.timeout() * work, kMinResponseTimeout),
+    kMaxResponseTimeout);
+
+  // Wait for the response, reading each part of it as soon as it arrives.
+  // Variable length responses are given a short grace period to complete once
+  // the minimum length has been received.
+  constexpr int kVariableLengthGrace = 20;  // Milliseconds
+  constexpr int kCancelCheckInterval = 100;  // Milliseconds
+  const auto start = std::chrono::steady_clock::now();
+  const auto deadline = start + std::chrono::duration_cast<
+    std::chrono::steady_clock::duration>(std::chrono::duration<double>(
+    timeout_seconds));
+  auto last_received = start;
+  while (total_bytes_read < max_response_length)
   {
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000
-      / kPollingFrequency));
+    int timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+      deadline - std::chrono::steady_clock::now()).count();
+    if (total_bytes_read >= min_response_length)
+      timeout = std::min(timeout, kVariableLengthGrace);
+    if ((timeout <= 0) || cancelled_)
+      break;
+    if (!serial_.WaitForData(std::min(timeout, kCancelCheckInterval)))
+    {
+      if (timeout <= kCancelCheckInterval)
+        break;
+      continue;
+    }
     rx_bytes_read = serial_.Read(rx_buffer, kBufferSize);
+    if (rx_bytes_read < 1)
+      continue;  // Nothing received yet.
+    last_received = std::chrono::steady_clock::now();
     if ((total_bytes_read + rx_bytes_read) <= max_response_length)
     {
       for (int j = 0; j < rx_bytes_read; ++j)
@@ -314,21 +760,44 @@ int MKComms::GetResponse(uint8_t* const response, const int min_response_length,
     total_bytes_read += rx_bytes_read;
   }
 
+  if (cancelled_)
+  {
+    Log::Error() << "ERROR: Cancelled." << std::endl;
+    return 0;
+  }
   if ((total_bytes_read < min_response_length) || (total_bytes_read
       > max_response_length))
   {
-    std::cerr << "ERROR: " << request_string << " request expected ";
+    Log::Error() << "ERROR: " << kRequestNames[request_type]
+      << " request expected ";
     if (min_response_length == max_response_length)
-      std::cerr << min_response_length;
+      Log::Error() << min_response_length;
     else
-      std::cerr << min_response_length << "to" << max_response_length;
-    std::cerr << " byte(s) in response, got " << total_bytes_read << "."
-      << std::endl;
+      Log::Error() << min_response_length << " to " << max_response_length;
+    Log::Error() << " byte(s) in response, got " << total_bytes_read
+      << " within " << timeout_seconds * 1000.0 << " ms." << std::endl;
     return 0;
   }
+
+  const double response_time = std::chrono::duration<double>(last_received
+    - start).count();
+  response_timer.AddSample(std::max(response_time - wire_time, 0.0) / work);
   return total_bytes_read;
 }
 
+std::vector<ResponseTimer>& MKComms::ResponseTimers() const
+{
+  std::vector<ResponseTimer> &response_timers = response_timers_[device_type_];
+  if (response_timers.empty())
+  {
+    response_timers.assign(REQUEST_TYPE_COUNT, ResponseTimer(
+      kInitialResponseTimeout));
+    response_timers[REQUEST_CLEAR_FLASH] = ResponseTimer(
+      kInitialClearTimeoutPerByte);
+  }
+  return response_timers;
+}
+
 void MKComms::Close()
 {
   serial_.Close();
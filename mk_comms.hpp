@@ -4,8 +4,13 @@
 #ifndef MK_COMMS_H_
 #define MK_COMMS_H_
 
+#include <atomic>
+#include <functional>
+#include <map>
 #include <string>
+#include <vector>
 
+#include "response_timer.hpp"
 #include "serial.hpp"
 
 class MKComms
@@ -19,34 +24,202 @@ public:
     DEVICE_TYPE_STR911 = 0xE0,
   };
 
-  MKComms(const std::string &comport)
-    : serial_(comport, 57600)
+  // Addresses of the boards in the application protocol.
+  enum Address
+  {
+    ADDRESS_FLIGHTCTRL = 1,
+    ADDRESS_NAVICTRL = 2,
+    ADDRESS_MK3MAG = 3,
+  };
+
+  // Boards that the NaviCtrl can pass its serial port through to.
+  enum RedirectTarget
+  {
+    REDIRECT_TARGET_FLIGHTCTRL = 0,
+    REDIRECT_TARGET_MK3MAG = 1,
+  };
+
+  // What a bootloader reports about itself (see Identify).
+  struct BootloaderInfo
+  {
+    int device_type;  // The signature, which may not be a supported type.
+    std::string version;  // e.g. "3.0"
+    int program_block_size;
+  };
+
+  // A program version, e.g. V0.88n is { 0, 88, 13 }.
+  struct FirmwareVersion
+  {
+    int major;
+    int minor;
+    int patch;  // 0 for "a".
+  };
+
+  MKComms(const std::string &comport, const int baudrate = 57600)
+    : serial_(comport, baudrate)
+    , baudrate_(baudrate)
     , device_type_(DEVICE_TYPE_UNSUPPORTED)
     , expected_response_index_(0)
-    , program_block_size_(0) {}
+    , program_block_size_(0)
+    , compressed_transfer_requested_(false)
+    , compressed_transfer_(false)
+    , program_bytes_sent_(0)
+    , cancelled_(false) {}
 
   operator bool() const { return serial_; }
   int program_block_size() const { return program_block_size_; }
+  enum DeviceType device_type() const { return device_type_; }
+  bool compressed_transfer() const { return compressed_transfer_; }
+  // Bytes sent on the wire by the last SendProgram (block headers, data, and
+  // CRCs).
+  int program_bytes_sent() const { return program_bytes_sent_; }
+
+  // Request run-length compressed block transfers. This only takes effect if
+  // the bootloader says that it supports them (see RequestBLComms).
+  void set_compressed_transfer(const bool compressed_transfer)
+    { compressed_transfer_requested_ = compressed_transfer; }
+
+  void set_trace(SerialTrace* const trace) { serial_.set_trace(trace); }
+
+  // Called after each block that SendProgram or ReadProgram transfers.
+  typedef std::function<void (const int blocks_done, const int blocks)>
+    ProgressHandler;
+  void set_progress_handler(const ProgressHandler &progress_handler)
+    { progress_handler_ = progress_handler; }
+
+  // Abandons the request in progress (from any thread) and fails any that
+  // follow.
+  void Cancel() { cancelled_ = true; }
+  bool cancelled() const { return cancelled_; }
+  bool SetLowLatency(const bool low_latency)
+    { return serial_.SetLowLatency(low_latency); }
+
+  // The mean time (in seconds) from sending a request that is acknowledged
+  // with a single byte to receiving the acknowledgement, or -1 on failure.
+  // The address is left at 0x0000.
+  double MeasureRoundTrip(const int requests) const;
+
+  // The device type that a hex file is built for, judging by its name.
+  static DeviceType DeviceTypeForImage(const std::string &hex_filename);
+  // Checks that hex files to be combined into one image are not built for
+  // different device types. Files whose names don't tell (e.g. parameters
+  // only) go with any. Reports an error and returns false if they differ.
+  static bool SameDeviceType(const std::vector<std::string> &hex_filenames);
+  // e.g. "NaviCtrl w/ STR911", or empty if the device type is unsupported.
+  static std::string BoardName(const DeviceType device_type);
+  // The application protocol address of the board with the given device type.
+  static Address AddressOf(const DeviceType device_type);
+  // The firmware version that a hex file contains, judging by its name (e.g.
+  // "..._V0_88n.hex"). Returns false if the name has no version.
+  static bool FirmwareVersionForImage(const std::string &hex_filename,
+    FirmwareVersion &version);
+  static std::string FirmwareVersionString(const FirmwareVersion &version);
+  static int FlashSize(const DeviceType device_type);
+  // The bytes that RequestClearFlash(bytes_to_clear) actually clears.
+  static int BytesCleared(const DeviceType device_type,
+    const int bytes_to_clear);
+  // A typical program block size for the device's bootloader (the real one is
+  // only known once the bootloader has been asked).
+  static int DefaultProgramBlockSize(const DeviceType device_type);
+  // The number of data bytes SendProgram sends for a block.
+  static int BlockPayloadSize(const uint8_t* const block,
+    const int program_block_size, const bool compressed_transfer);
+  // Each block load also sends a 4 byte header ('B', size, memory type) and a
+  // 2 byte CRC.
+  static constexpr int kBlockLoadOverheadBytes = 6;
+  // All of the bytes SendProgram sends for a block.
+  static int BlockBytesSent(const uint8_t* const block,
+    const int program_block_size, const bool compressed_transfer)
+    { return kBlockLoadOverheadBytes + BlockPayloadSize(block,
+      program_block_size, compressed_transfer); }
+
+  // Asks the NaviCtrl application to pass all further traffic through to the
+  // target board (e.g. to reach the FlightCtrl's bootloader) until EndRedirect.
+  bool RequestRedirect(const RedirectTarget target) const;
+  bool EndRedirect() const;
 
   bool RequestBLComms(const std::string &hex_filename);
+  // Resets the device, waits up to timeout_ms for its bootloader, reads what
+  // the bootloader reports about itself, then leaves it again. Nothing on the
+  // device is changed.
+  bool Identify(const int timeout_ms, BootloaderInfo &info);
   bool RequestClearFlash(const int bytes_to_clear) const;
   bool SendProgram(const uint8_t* const program, const int size) const;
+
+  // Reads size bytes of flash from address 0, passing each block to
+  // block_handler as it arrives.
+  bool ReadProgram(const int size, const std::function<void (
+    const uint8_t* const block, const int length)> &block_handler) const;
+  bool VerifyProgram(const uint8_t* const program, const int size) const;
   bool Exit() const;
+  // Asks the program at the given address for its version (in the application
+  // protocol), repeating the request until it answers or timeout_ms passes.
+  // This is how a program is seen to have started after Exit.
+  bool RequestFirmwareVersion(const Address address, const int timeout_ms,
+    FirmwareVersion &version) const;
   void Close();
 
 private:
+  // The kinds of request whose response times are estimated separately (see
+  // GetResponse).
+  enum RequestType
+  {
+    REQUEST_SIGNATURE = 0,
+    REQUEST_SET_DEVICE,
+    REQUEST_VERSION,
+    REQUEST_PROGRAM_BLOCK_SIZE,
+    REQUEST_SET_CLEAR_SIZE,
+    REQUEST_CLEAR_FLASH,
+    REQUEST_SET_ADDRESS,
+    REQUEST_BLOCK_LOAD,
+    REQUEST_BLOCK_READ,
+    REQUEST_COMPRESSION,
+    REQUEST_TYPE_COUNT,
+  };
+
+  // Resets the device and pings it until its bootloader answers.
+  bool WaitForBootloader(const int timeout_ms);
+  bool RequestSignature(uint8_t &signature) const;
+  bool RequestVersion(std::string &version) const;
+  bool RequestCompressionSupport(bool &supported) const;
+  bool RequestProgramBlockSize(int &program_block_size) const;
   bool RequestAddress(const int address) const;
   bool SendProgramBlock(const uint8_t* const block) const;
+  bool ReadProgramBlock(uint8_t* const block) const;
   int RequestDeviceReset() const;
+  // Sends a frame of the MikroKopter application protocol.
+  int SendFrame(const int address, const uint8_t command,
+    const uint8_t* const data, const int length) const;
   bool CheckResponse(const uint8_t* const expected_response,
     const int expected_response_length);
+  // Waits for the response to a request. The timeout allows for sending the
+  // last tx_bytes of the request and receiving the response at the baudrate,
+  // plus the smoothed response time of the request type (per unit of work,
+  // e.g. per byte cleared) and four times its deviation, but no less than a
+  // floor. Each response that is received updates the estimate of the device
+  // type it came from.
   int GetResponse(uint8_t* const response, const int min_response_length,
-    const int max_response_length, const std::string &request_string) const;
+    const int max_response_length, const RequestType request_type,
+    const int tx_bytes = 0, const int work = 1) const;
+  // The response timers of the current device type. They are kept across
+  // connections (e.g. for each board of a session), so that long, rare
+  // requests like clearing the flash are timed from more than one sample.
+  std::vector<ResponseTimer>& ResponseTimers() const;
 
   Serial serial_;
+  int baudrate_;
   enum DeviceType device_type_;
   int program_block_size_;
   int expected_response_index_;
+  bool compressed_transfer_requested_;
+  bool compressed_transfer_;
+  mutable std::vector<uint8_t> encoded_block_;
+  mutable int program_bytes_sent_;
+  ProgressHandler progress_handler_;
+  std::atomic<bool> cancelled_;
+  // Per device type, including DEVICE_TYPE_UNSUPPORTED for the requests made
+  // before the device has identified itself.
+  mutable std::map<DeviceType, std::vector<ResponseTimer>> response_timers_;
 };
 
 #endif // MK_COMMS_H_
\ No newline at end of file
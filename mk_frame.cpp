@@ -0,0 +1,65 @@
+#include "mk_frame.hpp"
+
+// ============================================================================+
+// Public functions:
+
+std::vector<uint8_t> MKFrame::Encode(const int address, const uint8_t command,
+  const uint8_t* const data, const int length)
+{
+  std::vector<uint8_t> frame = { '#', (uint8_t)('a' + address), command };
+  for (int i = 0; i < length; i += 3)
+  {
+    const uint8_t a = data[i];
+    const uint8_t b = (i + 1 < length) ? data[i + 1] : 0;
+    const uint8_t c = (i + 2 < length) ? data[i + 2] : 0;
+    frame.push_back('=' + (a >> 2));
+    frame.push_back('=' + (((a & 0x03) << 4) | (b >> 4)));
+    frame.push_back('=' + (((b & 0x0F) << 2) | (c >> 6)));
+    frame.push_back('=' + (c & 0x3F));
+  }
+  const int checksum = Checksum(frame.data(), frame.size());
+  frame.push_back('=' + checksum / 64);
+  frame.push_back('=' + checksum % 64);
+  frame.push_back('\r');
+  return frame;
+}
+
+bool MKFrame::Decode(const uint8_t* const frame, const int length,
+  int &address, uint8_t &command, std::vector<uint8_t> &data)
+{
+  // Header, checksum, and end, with the data in whole groups of four.
+  const int encoded_length = length - 6;
+  if ((length < 6) || (frame[0] != '#') || (frame[length - 1] != '\r')
+    || (encoded_length % 4))
+    return false;
+
+  const int checksum = Checksum(frame, length - 3);
+  if ((frame[length - 3] != '=' + checksum / 64)
+    || (frame[length - 2] != '=' + checksum % 64))
+    return false;
+
+  address = frame[1] - 'a';
+  command = frame[2];
+  data.clear();
+  for (int i = 3; i < 3 + encoded_length; i += 4)
+  {
+    uint8_t x[4];
+    for (int j = 0; j < 4; ++j)
+      x[j] = frame[i + j] - '=';
+    data.push_back((x[0] << 2) | (x[1] >> 4));
+    data.push_back(((x[1] & 0x0F) << 4) | (x[2] >> 2));
+    data.push_back(((x[2] & 0x03) << 6) | x[3]);
+  }
+  return true;
+}
+
+// ============================================================================+
+// Private  functions:
+
+int MKFrame::Checksum(const uint8_t* const frame, const int length)
+{
+  int checksum = 0;
+  for (int i = 0; i < length; ++i)
+    checksum += frame[i];
+  return checksum % 4096;
+}
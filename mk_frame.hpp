@@ -0,0 +1,30 @@
+// Frames of the MikroKopter application serial protocol, as described here:
+// http://www.mikrokopter.de/ucwiki/en/SerialProtocol
+// A frame is "#", the address + "a", a command character, the data packed six
+// bits per character (offset by "="), two checksum characters, and "\r".
+
+#ifndef MK_FRAME_H_
+#define MK_FRAME_H_
+
+#include <cinttypes>
+#include <vector>
+
+class MKFrame
+{
+public:
+  static std::vector<uint8_t> Encode(const int address, const uint8_t command,
+    const uint8_t* const data, const int length);
+
+  // Decodes a complete frame (from "#" through "\r"). Returns false if it is
+  // malformed or its checksum doesn't match. Note that the data is padded with
+  // zeros to a multiple of three bytes.
+  static bool Decode(const uint8_t* const frame, const int length,
+    int &address, uint8_t &command, std::vector<uint8_t> &data);
+
+private:
+  MKFrame();
+
+  static int Checksum(const uint8_t* const frame, const int length);
+};
+
+#endif // MK_FRAME_H_
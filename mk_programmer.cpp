@@ -0,0 +1,225 @@
+#include "mk_programmer.h"
+
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "intel_hex.hpp"
+#include "log.hpp"
+#include "programmer.hpp"
+
+struct mkp_image
+{
+  std::unique_ptr<IntelHex> hex;
+};
+
+struct mkp_session
+{
+  mkp_session(const char* const serial_port, const int baudrate,
+    const mkp_callbacks &callbacks)
+    : programmer(serial_port, baudrate)
+    , callbacks(callbacks) {}
+
+  Programmer programmer;
+  const mkp_callbacks callbacks;
+  std::mutex mutex;
+};
+
+static const mkp_callbacks kNoCallbacks = { nullptr, nullptr, nullptr };
+
+// Sends the messages of the calling thread to the message callback (or
+// nowhere) for as long as this is in scope.
+class CallbackSink : public Log::ScopedSink
+{
+public:
+  CallbackSink(const mkp_callbacks* const callbacks)
+    : Log::ScopedSink([callbacks](const bool error, const std::string &line) {
+        if (callbacks && callbacks->message)
+          callbacks->message(callbacks->user_data, error, line.c_str()); }) {}
+};
+
+// Reports the exception being handled, which must not propagate into C code.
+static void ReportException()
+{
+  try
+  {
+    throw;
+  }
+  catch (const std::exception &e)
+  {
+    Log::Error() << "ERROR: " << e.what() << std::endl;
+  }
+  catch (...)
+  {
+    Log::Error() << "ERROR: Unknown exception." << std::endl;
+  }
+}
+
+static mkp_status Status(const mkp_session* const session, const bool success)
+{
+  if (success)
+    return MKP_OK;
+  return session->programmer.cancelled() ? MKP_CANCELLED : MKP_ERROR;
+}
+
+// ============================================================================+
+// Public functions:
+
+int mkp_abi_version(void)
+{
+  return MKP_ABI_VERSION;
+}
+
+mkp_image *mkp_image_load(const char *const *filenames, int count,
+  const mkp_callbacks *callbacks)
+{
+  CallbackSink sink(callbacks);
+  if (!filenames || (count < 1))
+  {
+    Log::Error() << "ERROR: No hex files given." << std::endl;
+    return nullptr;
+  }
+
+  try
+  {
+    std::vector<std::unique_ptr<IntelHex>> parts;
+    for (int i = 0; i < count; ++i)
+    {
+      parts.emplace_back(new IntelHex(filenames[i]));
+      if (!*parts.back())
+        return nullptr;
+    }
+
+    std::unique_ptr<mkp_image> image(new mkp_image);
+    if (parts.size() == 1)
+    {
+      image->hex = std::move(parts[0]);
+    }
+    else
+    {
+      if (!MKComms::SameDeviceType(std::vector<std::string>(filenames,
+        filenames + count)))
+        return nullptr;
+      std::vector<const IntelHex*> part_pointers;
+      for (const std::unique_ptr<IntelHex> &part : parts)
+        part_pointers.push_back(part.get());
+      image->hex.reset(new IntelHex(part_pointers));
+      if (!*image->hex)
+        return nullptr;
+    }
+    return image.release();
+  }
+  catch (...)
+  {
+    ReportException();
+    return nullptr;
+  }
+}
+
+int mkp_image_size(const mkp_image *image)
+{
+  return image->hex->size();
+}
+
+void mkp_image_digest(const mkp_image *image, char digest[65])
+{
+  digest[0] = '\0';
+  try
+  {
+    const std::string hex_digest = image->hex->Digest();
+    hex_digest.copy(digest, 64);
+    digest[64] = '\0';
+  }
+  catch (...)
+  {
+    // There is no callback to report to, so leave the digest empty.
+  }
+}
+
+void mkp_image_free(mkp_image *image)
+{
+  delete image;
+}
+
+mkp_session *mkp_session_open(const char *serial_port, int baudrate,
+  const mkp_callbacks *callbacks)
+{
+  CallbackSink sink(callbacks);
+  try
+  {
+    std::unique_ptr<mkp_session> session(new mkp_session(serial_port,
+      baudrate, callbacks ? *callbacks : kNoCallbacks));
+    if (!session->programmer)
+      return nullptr;
+
+    const mkp_callbacks* const session_callbacks = &session->callbacks;
+    session->programmer.set_progress_handler([session_callbacks](
+      const Programmer::Phase phase, const int done, const int total) {
+        if (session_callbacks->progress)
+          session_callbacks->progress(session_callbacks->user_data,
+            static_cast<mkp_phase>(phase), done, total); });
+    return session.release();
+  }
+  catch (...)
+  {
+    ReportException();
+    return nullptr;
+  }
+}
+
+mkp_status mkp_flash(mkp_session *session, const mkp_image *image,
+  unsigned flags)
+{
+  CallbackSink sink(&session->callbacks);
+  try
+  {
+    std::lock_guard<std::mutex> lock(session->mutex);
+    Programmer &programmer = session->programmer;
+    programmer.mk_comms().set_compressed_transfer(flags & MKP_FLASH_COMPRESS);
+    programmer.set_verify(flags & MKP_FLASH_VERIFY);
+    programmer.set_confirm_boot(flags & MKP_FLASH_CONFIRM_BOOT);
+
+    RunStats stats;
+    const bool success = programmer.Connect(image->hex->filename(), stats)
+      && programmer.Flash(*image->hex, stats);
+    return Status(session, success);
+  }
+  catch (...)
+  {
+    ReportException();
+    return MKP_ERROR;
+  }
+}
+
+mkp_status mkp_verify(mkp_session *session, const mkp_image *image)
+{
+  CallbackSink sink(&session->callbacks);
+  try
+  {
+    std::lock_guard<std::mutex> lock(session->mutex);
+    RunStats stats;
+    const bool success = session->programmer.Connect(image->hex->filename(),
+      stats) && session->programmer.Verify(*image->hex);
+    return Status(session, success);
+  }
+  catch (...)
+  {
+    ReportException();
+    return MKP_ERROR;
+  }
+}
+
+void mkp_cancel(mkp_session *session)
+{
+  session->programmer.Cancel();
+}
+
+void mkp_session_close(mkp_session *session)
+{
+  if (!session)
+    return;
+  CallbackSink sink(&session->callbacks);
+  delete session;
+}
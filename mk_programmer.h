@@ -0,0 +1,90 @@
+/* C interface to the MikroKopter programmer (libmkprogrammer).
+ *
+ * Nothing is printed to the console. Messages are passed line by line to the
+ * message callback (which may be NULL to drop them), and progress to the
+ * progress callback. Callbacks run on the thread that made the call.
+ *
+ * Images are read-only once loaded and may be flashed by any number of
+ * sessions at once. Each session owns one serial port. Calls on a session are
+ * serialized, except for mkp_cancel, which may be called from any thread.
+ */
+
+#ifndef MK_PROGRAMMER_H_
+#define MK_PROGRAMMER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MKP_API __attribute__((visibility("default")))
+
+/* Incremented whenever this interface changes incompatibly. */
+#define MKP_ABI_VERSION 1
+
+typedef struct mkp_image mkp_image;
+typedef struct mkp_session mkp_session;
+
+typedef enum mkp_status
+{
+  MKP_OK = 0,
+  MKP_ERROR = 1,
+  MKP_CANCELLED = 2,
+} mkp_status;
+
+typedef enum mkp_phase
+{
+  MKP_PHASE_ERASE = 0,
+  MKP_PHASE_PROGRAM = 1,
+  MKP_PHASE_VERIFY = 2,
+} mkp_phase;
+
+typedef struct mkp_callbacks
+{
+  void (*message)(void *user_data, int is_error, const char *line);
+  void (*progress)(void *user_data, mkp_phase phase, int done, int total);
+  void *user_data;
+} mkp_callbacks;
+
+/* Flags for mkp_flash. */
+#define MKP_FLASH_COMPRESS 0x01 /* Compressed transfer, if supported. */
+#define MKP_FLASH_VERIFY   0x02 /* Read back and compare after programming. */
+#define MKP_FLASH_CONFIRM_BOOT 0x04 /* Wait for the new program to answer and
+                                     * check its version. */
+
+/* The MKP_ABI_VERSION that the library was built with. */
+MKP_API int mkp_abi_version(void);
+
+/* Parses one or more hex files into a single image. The files must not record
+ * data at the same address. The device type is judged by the file names.
+ * Returns NULL on failure. */
+MKP_API mkp_image *mkp_image_load(const char *const *filenames, int count,
+  const mkp_callbacks *callbacks);
+/* The number of bytes that will be flashed. */
+MKP_API int mkp_image_size(const mkp_image *image);
+/* Writes the SHA-256 of the bytes to be flashed (not of the hex file text) as
+ * 64 hex digits and a terminating NUL, or just the NUL on failure. */
+MKP_API void mkp_image_digest(const mkp_image *image, char digest[65]);
+MKP_API void mkp_image_free(mkp_image *image);
+
+/* Opens a serial port. The callbacks are used for every call on the session.
+ * Returns NULL on failure. */
+MKP_API mkp_session *mkp_session_open(const char *serial_port, int baudrate,
+  const mkp_callbacks *callbacks);
+/* Resets the board into its bootloader, then clears, programs, and optionally
+ * verifies its flash, and starts the new program. */
+MKP_API mkp_status mkp_flash(mkp_session *session, const mkp_image *image,
+  unsigned flags);
+/* Resets the board into its bootloader, compares its flash with the image,
+ * and starts the program. */
+MKP_API mkp_status mkp_verify(mkp_session *session, const mkp_image *image);
+/* Makes the call in progress on the session (and any later one) return
+ * MKP_CANCELLED as soon as possible. */
+MKP_API void mkp_cancel(mkp_session *session);
+/* Closes the port. No other call on the session may be in progress. */
+MKP_API void mkp_session_close(mkp_session *session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MK_PROGRAMMER_H_ */
@@ -0,0 +1,261 @@
+#include "mk_simulator.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "crc16.hpp"
+#include "log.hpp"
+#include "mk_frame.hpp"
+#include "rle.hpp"
+
+// Reported as bootloader V3.0, which accepts compressed transfers (answering
+// 'Y' when asked with 'z').
+static const uint8_t kBootloaderVersion[2] = { '3', '0' };
+static constexpr int kFlashSize = 1024 * 1024;
+// The simulated program ignores requests for this long after it is started.
+static constexpr std::chrono::milliseconds kBootTime(300);
+
+MKSimulator::MKSimulator(const MKComms::DeviceType device_type,
+  const int program_block_size, const int baudrate,
+  const MKComms::FirmwareVersion &firmware_version)
+  : device_type_(device_type)
+  , program_block_size_(program_block_size)
+  , firmware_version_(firmware_version)
+  , byte_time_(10 * std::chrono::nanoseconds(std::chrono::seconds(1))
+    / baudrate)  // 8N1 framing: 10 bits per byte.
+  , program_start_(std::chrono::steady_clock::now())
+  , stop_(false)
+  , flash_(kFlashSize, 0xFF)
+  , address_(0)
+{
+  if (pseudo_terminal_)
+    thread_ = std::thread(&MKSimulator::Run, this);
+}
+
+MKSimulator::~MKSimulator()
+{
+  stop_ = true;
+  if (thread_.joinable())
+    thread_.join();
+}
+
+// ============================================================================+
+// Private  functions:
+
+void MKSimulator::Run()
+{
+  // After 'E' the simulated device runs its program, which returns to the
+  // bootloader when it is woken up again (as after a reset request).
+  for (;;)
+  {
+    // Wait for the bootloader wake-up sequence (0x1B, 0xAA), handling any
+    // application protocol frames in the meantime.
+    uint8_t previous = 0, byte;
+    bool woken = false;
+    std::vector<uint8_t> frame;
+    while (!woken && Receive(&byte, 1))
+    {
+      woken = (previous == 0x1B) && (byte == 0xAA);
+      previous = byte;
+      if (byte == '#')
+        frame.clear();
+      else if (frame.empty())
+        continue;
+      frame.push_back(byte);
+      if (byte == '\r')
+      {
+        HandleFrame(frame);
+        frame.clear();
+      }
+    }
+    if (!woken)
+      return;
+    const uint8_t bootloader_init_string[4] = { 'M', 'K', 'B', 'L' };
+    Respond(bootloader_init_string, sizeof(bootloader_init_string));
+
+    bool in_bootloader = true;
+    uint8_t command;
+    while (in_bootloader && Receive(&command, 1))
+    {
+      uint8_t arguments[3];
+      switch (command)
+      {
+        case 0x1B:
+        case 0xAA:
+          // Left-over wake-up requests.
+          break;
+        case 't':
+        {
+          const uint8_t signature[2] = { (uint8_t)device_type_, 0x00 };
+          Respond(signature, sizeof(signature));
+          break;
+        }
+        case 'T':
+          if (Receive(arguments, 1))
+            Respond(arguments[0] == device_type_ ? 0x0D : '?');
+          break;
+        case 'V':
+          Respond(kBootloaderVersion, sizeof(kBootloaderVersion));
+          break;
+        case 'z':
+          Respond('Y');
+          break;
+        case 'b':
+        {
+          const uint8_t block_size[3] = { 'Y',
+            (uint8_t)((program_block_size_ >> 8) & 0xFF),
+            (uint8_t)(program_block_size_ & 0xFF) };
+          Respond(block_size, sizeof(block_size));
+          break;
+        }
+        case 'X':
+          if (Receive(arguments, 3))
+            Respond(0x0D);
+          break;
+        case 'e':
+          std::fill(flash_.begin(), flash_.end(), 0xFF);
+          Respond(0x0D);
+          break;
+        case 'A':
+          if (Receive(arguments, 2))
+          {
+            address_ = (arguments[0] << 8) | arguments[1];
+            Respond(0x0D);
+          }
+          break;
+        case 'B':
+          HandleBlockLoad();
+          break;
+        case 'g':
+          if (Receive(arguments, 3))
+          {
+            const int size = std::min((arguments[0] << 8) | arguments[1],
+              kFlashSize - address_);
+            Respond(flash_.data() + address_, size);
+            address_ += size;
+          }
+          break;
+        case 'E':
+          in_bootloader = false;
+          program_start_ = std::chrono::steady_clock::now();
+          break;
+        default:
+          Respond('?');
+          break;
+      }
+    }
+    if (in_bootloader)
+      return;  // Stopped.
+  }
+}
+
+// -----------------------------------------------------------------------------
+// This is the reference decoder for compressed ('Z') block transfers.
+void MKSimulator::HandleBlockLoad()
+{
+  uint8_t header[3];
+  if (!Receive(header, sizeof(header)))
+    return;
+  const int payload_size = (header[0] << 8) | header[1];
+  std::vector<uint8_t> payload(payload_size);
+  uint8_t crc_buffer[2];
+  if (!Receive(payload.data(), payload_size)
+    || !Receive(crc_buffer, sizeof(crc_buffer)))
+    return;
+
+  std::vector<uint8_t> block;
+  if (header[2] == 'F')
+  {
+    block.swap(payload);
+  }
+  else if (header[2] == 'Z')
+  {
+    block.resize(program_block_size_);
+    if (RLE::Decode(payload.data(), payload_size, block.data(),
+      program_block_size_) != program_block_size_)
+    {
+      Respond('?');
+      return;
+    }
+  }
+  else
+  {
+    Respond('?');
+    return;
+  }
+
+  CRC16 crc;
+  for (uint8_t byte : block)
+    crc.Update(byte);
+  if (crc.result() != ((crc_buffer[0] << 8) | crc_buffer[1]))
+  {
+    Respond('?');
+    return;
+  }
+
+  const int size = std::min<int>(block.size(), kFlashSize - address_);
+  std::copy(block.begin(), block.begin() + size, flash_.begin() + address_);
+  address_ += size;
+  Respond(0x0D);
+}
+
+// -----------------------------------------------------------------------------
+// Answers version requests to the simulated board once its program has
+// started. Other frames (e.g. reset requests) are ignored.
+void MKSimulator::HandleFrame(const std::vector<uint8_t> &frame)
+{
+  int address;
+  uint8_t command;
+  std::vector<uint8_t> data;
+  const MKComms::Address own_address = MKComms::AddressOf(device_type_);
+  if (!MKFrame::Decode(frame.data(), frame.size(), address, command, data)
+    || (address != own_address) || (command != 'v')
+    || (std::chrono::steady_clock::now() < program_start_ + kBootTime))
+    return;
+
+  // SWMajor, SWMinor, ProtoMajor, ProtoMinor, SWPatch, and HardwareError[5].
+  const uint8_t version[10] = { (uint8_t)firmware_version_.major,
+    (uint8_t)firmware_version_.minor, 11, 0,
+    (uint8_t)firmware_version_.patch, 0, 0, 0, 0, 0 };
+  const std::vector<uint8_t> response = MKFrame::Encode(own_address, 'V',
+    version, sizeof(version));
+  Respond(response.data(), response.size());
+}
+
+// -----------------------------------------------------------------------------
+// Blocks until length bytes have been received (and would have finished
+// arriving over the emulated link). Returns false if the simulator is stopped.
+bool MKSimulator::Receive(uint8_t* const buffer, const int length)
+{
+  int total_bytes_read = 0;
+  while (total_bytes_read < length)
+  {
+    if (stop_)
+      return false;
+    total_bytes_read += pseudo_terminal_.Read(buffer + total_bytes_read,
+      length - total_bytes_read, 100);
+  }
+  WaitForLink(length);
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+void MKSimulator::Respond(const uint8_t* const buffer, const int length)
+{
+  WaitForLink(length);
+  if (pseudo_terminal_.Write(buffer, length) != length)
+    Log::Error() << "ERROR: Simulator failed to respond." << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+// Advances the emulated link by the time it takes to transfer the given number
+// of bytes, and waits until then.
+void MKSimulator::WaitForLink(const int bytes)
+{
+  const auto now = std::chrono::steady_clock::now();
+  if (link_time_ < now)
+    link_time_ = now;
+  link_time_ += bytes * byte_time_;
+  std::this_thread::sleep_until(link_time_);
+}
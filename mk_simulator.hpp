@@ -0,0 +1,62 @@
+// Simulates a MikroKopter bootloader on a pseudo terminal so that the
+// programmer can be exercised (and timed) without hardware. The link speed of
+// a real serial port is emulated by delaying reception and responses by the
+// time the bytes would take on the wire at the given baudrate. Outside of the
+// bootloader (before it is woken and after 'E'), the simulated program answers
+// version requests with the given firmware version.
+
+#ifndef MK_SIMULATOR_H_
+#define MK_SIMULATOR_H_
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mk_comms.hpp"
+#include "pseudo_terminal.hpp"
+
+class MKSimulator
+{
+public:
+  MKSimulator(const MKComms::DeviceType device_type,
+    const int program_block_size, const int baudrate,
+    const MKComms::FirmwareVersion &firmware_version
+    = MKComms::FirmwareVersion());
+  ~MKSimulator();
+
+  operator bool() const { return pseudo_terminal_; }
+
+  // The name of the pseudo terminal to open in place of a serial port.
+  std::string port_name() const { return pseudo_terminal_.port_name(); }
+  const std::vector<uint8_t>& flash() const { return flash_; }
+
+private:
+  MKSimulator();
+  MKSimulator(const MKSimulator&);
+
+  void Run();
+  bool Receive(uint8_t* const buffer, const int length);
+  void Respond(const uint8_t* const buffer, const int length);
+  void Respond(const uint8_t byte) { Respond(&byte, 1); }
+  void WaitForLink(const int bytes);
+  void HandleBlockLoad();
+  void HandleFrame(const std::vector<uint8_t> &frame);
+
+  const MKComms::DeviceType device_type_;
+  const int program_block_size_;
+  const MKComms::FirmwareVersion firmware_version_;
+  const std::chrono::nanoseconds byte_time_;
+  std::chrono::steady_clock::time_point link_time_;
+  std::chrono::steady_clock::time_point program_start_;
+
+  PseudoTerminal pseudo_terminal_;
+  std::atomic<bool> stop_;
+  std::thread thread_;
+
+  std::vector<uint8_t> flash_;
+  int address_;
+};
+
+#endif // MK_SIMULATOR_H_
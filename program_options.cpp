@@ -1,60 +1,268 @@
 #include "program_options.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
 #include <iostream>
-#include <boost/program_options.hpp>
+#include <sstream>
+#include <thread>
+#include <vector>
 
-using namespace boost::program_options;
+enum ArgumentType
+{
+  ARGUMENT_NONE,
+  ARGUMENT_REQUIRED,
+  ARGUMENT_OPTIONAL,  // Only taken if the next word isn't another option.
+};
+
+struct CommandLineOption
+{
+  const char* long_name;
+  char short_name;
+  enum ArgumentType argument_type;
+  const char* description;
+  // Returns false if the argument is invalid.
+  std::function<bool (const std::string &argument)> store;
+};
+
+static bool ToInt(const std::string &argument, int &value)
+{
+  char* end;
+  const long result = strtol(argument.c_str(), &end, 10);
+  if (argument.empty() || *end || (result < 0) || (result > 0x7FFFFFFF))
+    return false;
+  value = result;
+  return true;
+}
+
+static bool ToDouble(const std::string &argument, double &value)
+{
+  char* end;
+  value = strtod(argument.c_str(), &end);
+  return !argument.empty() && !*end;
+}
+
+static void PrintHelp(const std::vector<CommandLineOption> &options)
+{
+  std::cout << "Usage: mk-programmer [options] input-file...\n\n"
+    << "Allowed options:\n";
+  for (const CommandLineOption &option : options)
+  {
+    std::ostringstream names;
+    names << "  ";
+    if (option.short_name)
+      names << "-" << option.short_name << " [ --" << option.long_name << " ]";
+    else
+      names << "--" << option.long_name;
+    if (option.argument_type == ARGUMENT_REQUIRED)
+      names << " arg";
+    else if (option.argument_type == ARGUMENT_OPTIONAL)
+      names << " [arg]";
+    std::cout << std::left << std::setw(30) << names.str();
+    if (names.str().length() >= 30)
+      std::cout << "\n" << std::setw(30) << "";
+    std::cout << option.description << "\n";
+  }
+  std::cout << std::endl;
+}
 
 ProgramOptions::ProgramOptions(const int argc, const char* const argv[])
-  : hex_filename_("input.hex")
+  : hex_filenames_(1, "input.hex")
+  , jobs_(std::max(1u, std::thread::hardware_concurrency()))
   , serial_port_("/dev/ttyUSB0")
   , continue_program_(true)
+  , compress_(false)
+  , simulate_(false)
+  , replay_speed_(1.0)
+  , baudrate_(57600)
+  , list_ports_(false)
+  , verify_(false)
+  , confirm_boot_(false)
+  , dump_size_(0)
+  , low_latency_(false)
+  , calibrate_rtt_(false)
+  , dry_run_(false)
+  , session_(false)
+  , inventory_(false)
+  , json_(false)
 {
-  try
-  {
-    // Declare the supported options.
-    options_description visible("Allowed options");
-    visible.add_options()
-      ("help,h", "produce help message")
-      ("port,p", value<std::string>()->implicit_value(serial_port_), "serial port")
-      ;
-
-    // Hidden options, will not be shown to the user.
-    options_description hidden("Hidden options");
-    hidden.add_options()
-      ("input-file", value<std::string>(), "input file")
-      ;
+  bool help = false;
+  const std::string default_serial_port = serial_port_;
 
-    options_description cmdline_options;
-    cmdline_options.add(visible).add(hidden);
+  // Declare the supported options.
+  const std::vector<CommandLineOption> options = {
+    { "help", 'h', ARGUMENT_NONE, "produce help message",
+      [&](const std::string &) { return help = true; } },
+    { "port", 'p', ARGUMENT_OPTIONAL, "serial port (default /dev/ttyUSB0)",
+      [&](const std::string &argument) {
+        serial_port_ = argument.empty() ? default_serial_port : argument;
+        return true; } },
+    { "baud", 'b', ARGUMENT_REQUIRED, "serial baudrate (default 57600)",
+      [&](const std::string &argument) {
+        return ToInt(argument, baudrate_); } },
+    { "low-latency", 0, ARGUMENT_NONE,
+      "minimize serial port latency (USB adapters)",
+      [&](const std::string &) { return low_latency_ = true; } },
+    { "calibrate-rtt", 0, ARGUMENT_NONE,
+      "measure the acknowledgement round trip with and without low latency",
+      [&](const std::string &) { return calibrate_rtt_ = true; } },
+    { "list-ports", 0, ARGUMENT_NONE, "list candidate serial ports and exit",
+      [&](const std::string &) { return list_ports_ = true; } },
+    { "inventory", 0, ARGUMENT_NONE,
+      "list the bootloader on each serial port and exit (changes nothing)",
+      [&](const std::string &) { return inventory_ = true; } },
+    { "json", 0, ARGUMENT_NONE, "print the inventory as JSON",
+      [&](const std::string &) { return json_ = true; } },
+    { "batch", 0, ARGUMENT_REQUIRED,
+      "flash the matching image onto each board of a saved inventory table,"
+      " up to --jobs at a time",
+      [&](const std::string &argument) {
+        batch_filename_ = argument;
+        return true; } },
+    { "manifest", 'm', ARGUMENT_REQUIRED,
+      "check the image digests (as printed by --dry-run) against a manifest",
+      [&](const std::string &argument) {
+        manifest_filename_ = argument;
+        return true; } },
+    { "compress", 0, ARGUMENT_NONE,
+      "use compressed transfers if the bootloader supports them",
+      [&](const std::string &) { return compress_ = true; } },
+    { "dry-run", 0, ARGUMENT_NONE,
+      "predict the programming time without a device (calibrated by --stats)",
+      [&](const std::string &) { return dry_run_ = true; } },
+    { "session", 0, ARGUMENT_NONE,
+      "flash each image onto its own board, reaching the FlightCtrl through"
+      " the NaviCtrl",
+      [&](const std::string &) { return session_ = true; } },
+    { "verify", 0, ARGUMENT_NONE, "read back and compare after programming",
+      [&](const std::string &) { return verify_ = true; } },
+    { "confirm-boot", 0, ARGUMENT_NONE,
+      "wait for the new program to start and check its version",
+      [&](const std::string &) { return confirm_boot_ = true; } },
+    { "dump", 0, ARGUMENT_REQUIRED,
+      "save the device's flash to a .hex or binary file and exit",
+      [&](const std::string &argument) {
+        dump_filename_ = argument;
+        return true; } },
+    { "dump-size", 0, ARGUMENT_REQUIRED,
+      "bytes of flash to dump (default all of it)",
+      [&](const std::string &argument) {
+        return ToInt(argument, dump_size_); } },
+    { "jobs", 'j', ARGUMENT_REQUIRED,
+      "number of threads for parallel work (default: one per core)",
+      [&](const std::string &argument) {
+        return ToInt(argument, jobs_) && (jobs_ > 0); } },
+    { "stats", 0, ARGUMENT_REQUIRED, "append the timing of this run to a file",
+      [&](const std::string &argument) {
+        stats_filename_ = argument;
+        return true; } },
+    { "simulate", 0, ARGUMENT_NONE,
+      "program a simulated bootloader instead of a serial port",
+      [&](const std::string &) { return simulate_ = true; } },
+    { "trace", 0, ARGUMENT_REQUIRED, "record serial traffic to a trace file",
+      [&](const std::string &argument) {
+        trace_filename_ = argument;
+        return true; } },
+    { "decode-trace", 0, ARGUMENT_REQUIRED, "print a recorded trace and exit",
+      [&](const std::string &argument) {
+        decode_trace_filename_ = argument;
+        return true; } },
+    { "replay", 0, ARGUMENT_REQUIRED,
+      "program against the device responses in a recorded trace",
+      [&](const std::string &argument) {
+        replay_filename_ = argument;
+        return true; } },
+    { "replay-speed", 0, ARGUMENT_REQUIRED,
+      "replay speed relative to the recording (default 1.0)",
+      [&](const std::string &argument) {
+        return ToDouble(argument, replay_speed_); } },
+  };
 
-    positional_options_description positional_options;
-    positional_options.add("input-file", -1);
+  bool have_input_file = false;
+  for (int i = 1; continue_program_ && (i < argc); ++i)
+  {
+    const std::string word = argv[i];
 
-    variables_map vm;
-    store(command_line_parser(argc, argv).options(cmdline_options)
-      .positional(positional_options).run(), vm);
-    notify(vm);
+    // Anything that doesn't look like an option is an input file.
+    if ((word.length() < 2) || (word[0] != '-'))
+    {
+      if (!have_input_file)
+        hex_filenames_.clear();
+      hex_filenames_.push_back(word);
+      have_input_file = true;
+      continue;
+    }
 
-    if (vm.count("help"))
+    // Find the option by its long (--name[=argument]) or short (-n[argument])
+    // name.
+    const CommandLineOption* option = nullptr;
+    std::string argument;
+    bool have_argument = false;
+    if (word[1] == '-')
+    {
+      const size_t equals = word.find('=');
+      const std::string name = word.substr(2, equals - 2);
+      for (const CommandLineOption &candidate : options)
+        if (name == candidate.long_name)
+          option = &candidate;
+      if (equals != std::string::npos)
+      {
+        argument = word.substr(equals + 1);
+        have_argument = true;
+      }
+    }
+    else
+    {
+      for (const CommandLineOption &candidate : options)
+        if (word[1] == candidate.short_name)
+          option = &candidate;
+      if (word.length() > 2)
+      {
+        argument = word.substr(2);
+        have_argument = true;
+      }
+    }
+    if (!option)
     {
-      std::cout << visible << "\n";
+      std::cerr << "ERROR: Unrecognized option '" << word << "'." << std::endl;
       continue_program_ = false;
+      break;
     }
 
-    if (vm.count("port"))
+    // The argument may also be given as the following word.
+    if (!have_argument && (i + 1 < argc)
+      && ((option->argument_type == ARGUMENT_REQUIRED)
+      || ((option->argument_type == ARGUMENT_OPTIONAL) && argv[i + 1][0]
+      != '-')))
     {
-      serial_port_ = vm["port"].as<std::string>();
+      argument = argv[++i];
+      have_argument = true;
     }
 
-    if (vm.count("input-file"))
+    if (have_argument && (option->argument_type == ARGUMENT_NONE))
     {
-      hex_filename_ = vm["input-file"].as<std::string>();
+      std::cerr << "ERROR: Option '--" << option->long_name
+        << "' does not take an argument." << std::endl;
+      continue_program_ = false;
+    }
+    else if (!have_argument && (option->argument_type == ARGUMENT_REQUIRED))
+    {
+      std::cerr << "ERROR: Option '--" << option->long_name
+        << "' requires an argument." << std::endl;
+      continue_program_ = false;
+    }
+    else if (!option->store(argument))
+    {
+      std::cerr << "ERROR: Invalid argument '" << argument << "' for option '--"
+        << option->long_name << "'." << std::endl;
+      continue_program_ = false;
     }
   }
-  catch (std::exception& e)
+
+  if (help)
   {
-    std::cerr << e.what() << "\n\n";
+    PrintHelp(options);
     continue_program_ = false;
   }
 }
@@ -2,6 +2,7 @@
 #define PROGRAM_OPTIONS_H_
 
 #include <string>
+#include <vector>
 
 class ProgramOptions
 {
@@ -10,15 +11,61 @@ public:
 
   operator bool() const { return continue_program_; }
 
-  std::string hex_filename() const { return hex_filename_; }
+  // The first input file (the one that determines the device type).
+  std::string hex_filename() const { return hex_filenames_.front(); }
+  std::vector<std::string> hex_filenames() const { return hex_filenames_; }
+  int jobs() const { return jobs_; }
   std::string serial_port() const { return serial_port_; }
+  std::string manifest_filename() const { return manifest_filename_; }
+  bool compress() const { return compress_; }
+  bool simulate() const { return simulate_; }
+  std::string trace_filename() const { return trace_filename_; }
+  std::string decode_trace_filename() const { return decode_trace_filename_; }
+  std::string replay_filename() const { return replay_filename_; }
+  double replay_speed() const { return replay_speed_; }
+  int baudrate() const { return baudrate_; }
+  bool list_ports() const { return list_ports_; }
+  std::string stats_filename() const { return stats_filename_; }
+  bool verify() const { return verify_; }
+  bool confirm_boot() const { return confirm_boot_; }
+  std::string dump_filename() const { return dump_filename_; }
+  int dump_size() const { return dump_size_; }
+  bool low_latency() const { return low_latency_; }
+  bool calibrate_rtt() const { return calibrate_rtt_; }
+  bool dry_run() const { return dry_run_; }
+  bool session() const { return session_; }
+  bool inventory() const { return inventory_; }
+  bool json() const { return json_; }
+  std::string batch_filename() const { return batch_filename_; }
 
 private:
   ProgramOptions() {}
   bool continue_program_;
 
-  std::string hex_filename_;
+  std::vector<std::string> hex_filenames_;
+  int jobs_;
   std::string serial_port_;
+  std::string manifest_filename_;
+  bool compress_;
+  bool simulate_;
+  std::string trace_filename_;
+  std::string decode_trace_filename_;
+  std::string replay_filename_;
+  double replay_speed_;
+  int baudrate_;
+  bool list_ports_;
+  std::string stats_filename_;
+  bool verify_;
+  bool confirm_boot_;
+  std::string dump_filename_;
+  int dump_size_;
+  bool low_latency_;
+  bool calibrate_rtt_;
+  bool dry_run_;
+  bool session_;
+  bool inventory_;
+  bool json_;
+  std::string batch_filename_;
 };
 
 #endif // PROGRAM_OPTIONS_H_
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "programmer.hpp"
+
+#include <chrono>
+#include <iostream>
+
+#include "log.hpp"
+#include "response_timer.hpp"
+
+// ============================================================================+
+// Public functions:
+
+Programmer::Programmer(const std::string &serial_port, const int baudrate)
+  : mk_comms_(serial_port, baudrate)
+  , serial_port_(serial_port)
+  , baudrate_(baudrate)
+  , verify_(false)
+  , confirm_boot_(false)
+  , phase_(PHASE_PROGRAM)
+{
+  mk_comms_.set_progress_handler([this](const int done, const int total) {
+    if (progress_handler_)
+      progress_handler_(phase_, done, total); });
+}
+
+bool Programmer::Connect(const std::string &hex_filename, RunStats &stats)
+{
+  stats.serial_port = serial_port_;
+  stats.baudrate = baudrate_;
+
+  const auto start = std::chrono::steady_clock::now();
+  const bool connected = mk_comms_.RequestBLComms(hex_filename);
+  stats.handshake_seconds = SecondsSince(start);
+  return connected;
+}
+
+bool Programmer::Flash(const IntelHex &hex, RunStats &stats)
+{
+  stats.device_type = mk_comms_.device_type();
+  stats.program_block_size = mk_comms_.program_block_size();
+  stats.image_bytes = hex.size();
+  stats.blocks = (hex.size() - 1) / mk_comms_.program_block_size() + 1;
+
+  // Clear the flash memory.
+  if (progress_handler_)
+    progress_handler_(PHASE_ERASE, 0, 1);
+  auto phase_start = std::chrono::steady_clock::now();
+  const bool cleared = mk_comms_.RequestClearFlash(hex.size());
+  stats.erase_seconds = SecondsSince(phase_start);
+  if (!cleared)
+    return false;
+  if (progress_handler_)
+    progress_handler_(PHASE_ERASE, 1, 1);
+
+  // Send the contents of the hex file to the device.
+  phase_ = PHASE_PROGRAM;
+  phase_start = std::chrono::steady_clock::now();
+  const bool programmed = mk_comms_.SendProgram(hex.program(), hex.size());
+  stats.program_seconds = SecondsSince(phase_start);
+  stats.program_bytes_sent = mk_comms_.program_bytes_sent();
+  if (!programmed)
+    return false;
+  Log::Info() << "Programming took " << stats.program_seconds << " s."
+    << std::endl;
+
+  if (verify_ && !ReadBack(hex))
+    return false;
+
+  if (!mk_comms_.Exit())
+    return false;
+  return !confirm_boot_ || ConfirmBoot(hex, stats);
+}
+
+bool Programmer::Verify(const IntelHex &hex)
+{
+  return ReadBack(hex) && mk_comms_.Exit();
+}
+
+bool Programmer::FlashSession(const std::vector<const IntelHex*> &images,
+  const StatsHandler &stats_handler)
+{
+  for (const bool navi_ctrl : { false, true })
+  {
+    std::vector<const IntelHex*> candidates;
+    for (const IntelHex* const image : images)
+      if ((MKComms::DeviceTypeForImage(image->filename())
+        == MKComms::DEVICE_TYPE_STR911) == navi_ctrl)
+        candidates.push_back(image);
+    if (candidates.empty())
+      continue;
+
+    if (!navi_ctrl
+      && !mk_comms_.RequestRedirect(MKComms::REDIRECT_TARGET_FLIGHTCTRL))
+      return false;
+
+    RunStats stats;
+    bool flashed = Connect("", stats);
+    if (flashed)
+    {
+      const IntelHex* hex = nullptr;
+      for (const IntelHex* const candidate : candidates)
+        if (MKComms::DeviceTypeForImage(candidate->filename())
+          == mk_comms_.device_type())
+          hex = candidate;
+      if (hex)
+      {
+        flashed = Flash(*hex, stats);
+      }
+      else
+      {
+        Log::Error() << "ERROR: None of the images is for the board that"
+          << " answered." << std::endl;
+        mk_comms_.Exit();
+        flashed = false;
+      }
+    }
+    stats.success = flashed;
+    if (stats_handler)
+      stats_handler(stats);
+
+    if (!navi_ctrl)
+      mk_comms_.EndRedirect();
+    if (!flashed)
+      return false;
+  }
+  return true;
+}
+
+// ============================================================================+
+// Private  functions:
+
+bool Programmer::ConfirmBoot(const IntelHex &hex, RunStats &stats)
+{
+  constexpr int kBootTimeout = 10000;  // Milliseconds
+  Log::Info() << "Waiting for the program to start." << std::endl;
+
+  const auto start = std::chrono::steady_clock::now();
+  MKComms::FirmwareVersion version;
+  if (!mk_comms_.RequestFirmwareVersion(MKComms::AddressOf(
+    mk_comms_.device_type()), kBootTimeout, version))
+  {
+    if (!mk_comms_.cancelled())
+      Log::Error() << "ERROR: The program didn't answer within "
+        << kBootTimeout / 1000 << " s." << std::endl;
+    return false;
+  }
+  stats.boot_seconds = SecondsSince(start);
+  Log::Info() << "Firmware " << MKComms::FirmwareVersionString(version)
+    << " is running after " << stats.boot_seconds << " s." << std::endl;
+
+  MKComms::FirmwareVersion expected;
+  if (!MKComms::FirmwareVersionForImage(hex.filename(), expected))
+  {
+    Log::Info() << "The name of " << hex.filename() << " has no version to"
+      << " compare with." << std::endl;
+    return true;
+  }
+  if ((version.major != expected.major) || (version.minor != expected.minor)
+    || (version.patch != expected.patch))
+  {
+    Log::Error() << "ERROR: The image is "
+      << MKComms::FirmwareVersionString(expected) << "." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool Programmer::ReadBack(const IntelHex &hex)
+{
+  phase_ = PHASE_VERIFY;
+  const bool verified = mk_comms_.VerifyProgram(hex.program(), hex.size());
+  phase_ = PHASE_PROGRAM;
+  return verified;
+}
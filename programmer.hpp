@@ -0,0 +1,82 @@
+// The sequence of bootloader requests that programs a MikroKopter board, shared
+// by the command line tool and the C interface (mk_programmer.h). Messages are
+// printed through Log, so a thread can redirect them with Log::ScopedSink.
+
+#ifndef PROGRAMMER_H_
+#define PROGRAMMER_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "intel_hex.hpp"
+#include "mk_comms.hpp"
+#include "run_stats.hpp"
+
+class Programmer
+{
+public:
+  enum Phase
+  {
+    PHASE_ERASE = 0,
+    PHASE_PROGRAM = 1,
+    PHASE_VERIFY = 2,
+  };
+
+  typedef std::function<void (const Phase phase, const int done,
+    const int total)> ProgressHandler;
+  typedef std::function<void (const RunStats &stats)> StatsHandler;
+
+  Programmer(const std::string &serial_port, const int baudrate);
+
+  operator bool() const { return mk_comms_; }
+  MKComms &mk_comms() { return mk_comms_; }
+
+  // Read back and compare the flash after programming.
+  void set_verify(const bool verify) { verify_ = verify; }
+  // After programming, wait for the new program to answer a version request
+  // and check the version against the image's name.
+  void set_confirm_boot(const bool confirm_boot)
+    { confirm_boot_ = confirm_boot; }
+  void set_progress_handler(const ProgressHandler &progress_handler)
+    { progress_handler_ = progress_handler; }
+
+  // Resets the board and waits for its bootloader. The board must match the
+  // hex file, unless hex_filename is empty. The handshake time goes in stats.
+  bool Connect(const std::string &hex_filename, RunStats &stats);
+  // Clears, programs, and (optionally) verifies the flash of the connected
+  // board, then starts the new program.
+  bool Flash(const IntelHex &hex, RunStats &stats);
+  // Compares the flash of the connected board with the image, then starts the
+  // program.
+  bool Verify(const IntelHex &hex);
+
+  // Flashes each image onto its own board of an assembled MikroKopter, all
+  // through the NaviCtrl's serial port: first the FlightCtrl (through the
+  // NaviCtrl's redirect), then the NaviCtrl itself. Images are matched to
+  // boards by device type and boards without an image are left alone. The
+  // stats of each board are passed to stats_handler.
+  bool FlashSession(const std::vector<const IntelHex*> &images,
+    const StatsHandler &stats_handler);
+
+  // Abandons the operation in progress. This may be called from any thread.
+  void Cancel() { mk_comms_.Cancel(); }
+  bool cancelled() const { return mk_comms_.cancelled(); }
+
+private:
+  Programmer();
+  Programmer(const Programmer&);
+
+  bool ReadBack(const IntelHex &hex);
+  bool ConfirmBoot(const IntelHex &hex, RunStats &stats);
+
+  MKComms mk_comms_;
+  std::string serial_port_;
+  int baudrate_;
+  bool verify_;
+  bool confirm_boot_;
+  Phase phase_;
+  ProgressHandler progress_handler_;
+};
+
+#endif // PROGRAMMER_H_
@@ -0,0 +1,60 @@
+#include "pseudo_terminal.hpp"
+
+#include <iostream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "log.hpp"
+
+PseudoTerminal::PseudoTerminal()
+  : master_id_(-1)
+  , slave_id_(-1)
+{
+  master_id_ = posix_openpt(O_RDWR | O_NOCTTY);
+  if ((master_id_ == -1) || grantpt(master_id_) || unlockpt(master_id_))
+  {
+    Log::Error() << "ERROR: Unable to create a pseudo terminal." << std::endl;
+    if (master_id_ != -1)
+      close(master_id_);
+    master_id_ = -1;
+    return;
+  }
+  port_name_ = ptsname(master_id_);
+
+  // Hold the slave side open so that the master doesn't see a hangup before
+  // (or between) the programmer opening the port, and make it raw so nothing
+  // is echoed back.
+  slave_id_ = open(port_name_.c_str(), O_RDWR | O_NOCTTY);
+  struct termios settings;
+  if ((slave_id_ != -1) && (tcgetattr(slave_id_, &settings) == 0))
+  {
+    cfmakeraw(&settings);
+    tcsetattr(slave_id_, TCSANOW, &settings);
+  }
+}
+
+PseudoTerminal::~PseudoTerminal()
+{
+  if (slave_id_ != -1)
+    close(slave_id_);
+  if (master_id_ != -1)
+    close(master_id_);
+}
+
+int PseudoTerminal::Read(uint8_t* const buffer, const int length,
+  const int timeout_ms) const
+{
+  struct pollfd poll_fd = { master_id_, POLLIN, 0 };
+  if (poll(&poll_fd, 1, timeout_ms) < 1)
+    return 0;
+  const int bytes_read = read(master_id_, buffer, length);
+  return bytes_read > 0 ? bytes_read : 0;
+}
+
+int PseudoTerminal::Write(const uint8_t* const buffer, const int length) const
+{
+  return write(master_id_, buffer, length);
+}
@@ -0,0 +1,33 @@
+// A pseudo terminal that stands in for a serial port. The programmer opens the
+// slave side by name (port_name) while this class drives the master side.
+
+#ifndef PSEUDO_TERMINAL_H_
+#define PSEUDO_TERMINAL_H_
+
+#include <cinttypes>
+#include <string>
+
+class PseudoTerminal
+{
+public:
+  PseudoTerminal();
+  ~PseudoTerminal();
+
+  operator bool() const { return master_id_ != -1; }
+
+  std::string port_name() const { return port_name_; }
+
+  // Waits up to timeout_ms for data from the programmer. Returns the number of
+  // bytes read, or 0 if there were none (including when the port isn't open).
+  int Read(uint8_t* const buffer, const int length, const int timeout_ms) const;
+  int Write(const uint8_t* const buffer, const int length) const;
+
+private:
+  PseudoTerminal(const PseudoTerminal&);
+
+  int master_id_;
+  int slave_id_;
+  std::string port_name_;
+};
+
+#endif // PSEUDO_TERMINAL_H_
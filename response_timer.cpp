@@ -0,0 +1,41 @@
+#include "response_timer.hpp"
+
+#include <cmath>
+
+// Gains from RFC 6298.
+static constexpr double kAlpha = 1.0 / 8.0;
+static constexpr double kBeta = 1.0 / 4.0;
+static constexpr double kVariationFactor = 4.0;
+
+// ============================================================================+
+// Public functions:
+
+double ResponseTimer::timeout() const
+{
+  if (!samples_)
+    return initial_timeout_;
+  return smoothed_ + kVariationFactor * variation_;
+}
+
+void ResponseTimer::AddSample(const double response_time)
+{
+  if (!samples_)
+  {
+    smoothed_ = response_time;
+    variation_ = response_time / 2.0;
+  }
+  else
+  {
+    variation_ = (1.0 - kBeta) * variation_ + kBeta * std::fabs(smoothed_
+      - response_time);
+    smoothed_ = (1.0 - kAlpha) * smoothed_ + kAlpha * response_time;
+  }
+  ++samples_;
+}
+
+// -----------------------------------------------------------------------------
+double SecondsSince(const std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now()
+    - start).count();
+}
@@ -0,0 +1,38 @@
+// Smoothed round trip time estimation for one kind of request, in the manner
+// of TCP's retransmission timeout (RFC 6298): the timeout follows the smoothed
+// response time plus four times its mean deviation, so that it is short on a
+// quick, steady link and grows on a slow or erratic one.
+
+#ifndef RESPONSE_TIMER_H_
+#define RESPONSE_TIMER_H_
+
+#include <chrono>
+
+// The time in seconds since start, e.g. for timing a response.
+double SecondsSince(const std::chrono::steady_clock::time_point start);
+
+class ResponseTimer
+{
+public:
+  // initial_timeout is used until the first response has been timed.
+  ResponseTimer(const double initial_timeout)
+    : initial_timeout_(initial_timeout)
+    , smoothed_(0.0)
+    , variation_(0.0)
+    , samples_(0) {}
+
+  double timeout() const;
+  int samples() const { return samples_; }
+
+  void AddSample(const double response_time);
+
+private:
+  ResponseTimer();
+
+  double initial_timeout_;
+  double smoothed_;
+  double variation_;
+  int samples_;
+};
+
+#endif // RESPONSE_TIMER_H_
@@ -0,0 +1,112 @@
+#include "rle.hpp"
+
+#include <cstring>
+
+static constexpr int kMinRun = 3;
+static constexpr int kMaxRun = 130;
+static constexpr int kMaxLiterals = 128;
+
+// -----------------------------------------------------------------------------
+// Length of the run of identical bytes starting at data[0] (at most kMaxRun).
+static int RunLength(const uint8_t* const data, const int length)
+{
+  int run = 1;
+  while ((run < length) && (run < kMaxRun) && (data[run] == data[0]))
+    ++run;
+  return run;
+}
+
+// -----------------------------------------------------------------------------
+int RLE::EncodedSize(const uint8_t* const data, const int length)
+{
+  int size = 0, literals = 0;
+  for (int i = 0; i < length; )
+  {
+    const int run = RunLength(data + i, length - i);
+    if (run >= kMinRun)
+    {
+      literals = 0;
+      size += 2;
+      i += run;
+    }
+    else
+    {
+      if (literals++ % kMaxLiterals == 0)
+        ++size;  // Control byte for a new literal packet.
+      ++size;
+      ++i;
+    }
+  }
+  return size;
+}
+
+// -----------------------------------------------------------------------------
+int RLE::Encode(const uint8_t* const data, const int length,
+  uint8_t* const encoded)
+{
+  int size = 0, literal_start = 0, literals = 0;
+  for (int i = 0; i < length; )
+  {
+    const int run = RunLength(data + i, length - i);
+    if ((run >= kMinRun) || (literals == kMaxLiterals))
+    {
+      // Flush any pending literals.
+      if (literals)
+      {
+        encoded[size++] = literals - 1;
+        memcpy(encoded + size, data + literal_start, literals);
+        size += literals;
+        literals = 0;
+      }
+    }
+    if (run >= kMinRun)
+    {
+      encoded[size++] = run + 125;
+      encoded[size++] = data[i];
+      i += run;
+    }
+    else
+    {
+      if (!literals)
+        literal_start = i;
+      ++literals;
+      ++i;
+    }
+  }
+  if (literals)
+  {
+    encoded[size++] = literals - 1;
+    memcpy(encoded + size, data + literal_start, literals);
+    size += literals;
+  }
+  return size;
+}
+
+// -----------------------------------------------------------------------------
+int RLE::Decode(const uint8_t* const encoded, const int encoded_length,
+  uint8_t* const decoded, const int max_length)
+{
+  int size = 0;
+  for (int i = 0; i < encoded_length; )
+  {
+    const int control = encoded[i++];
+    if (control < kMaxLiterals)
+    {
+      const int literals = control + 1;
+      if ((i + literals > encoded_length) || (size + literals > max_length))
+        return -1;
+      memcpy(decoded + size, encoded + i, literals);
+      size += literals;
+      i += literals;
+    }
+    else
+    {
+      const int run = control - 125;
+      if ((i >= encoded_length) || (size + run > max_length))
+        return -1;
+      memset(decoded + size, encoded[i++], run);
+      size += run;
+    }
+  }
+  return size;
+}
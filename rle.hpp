@@ -0,0 +1,34 @@
+#ifndef RLE_H_
+#define RLE_H_
+
+#include <cinttypes>
+
+// PackBits-style run-length coding used for compressed program block
+// transfers. Each packet starts with a control byte n:
+//   0-127:   the next n + 1 bytes are copied literally
+//   128-255: the next byte is repeated n - 125 times (3 to 130 repeats)
+class RLE
+{
+public:
+  // Maximum encoded size of a block of the given length (all literals).
+  static int MaxEncodedSize(const int length) { return length + length / 128
+    + 1; }
+
+  // The exact number of bytes Encode would produce, without encoding.
+  static int EncodedSize(const uint8_t* const data, const int length);
+
+  // Returns the number of bytes written to encoded, which must be able to hold
+  // MaxEncodedSize(length) bytes.
+  static int Encode(const uint8_t* const data, const int length,
+    uint8_t* const encoded);
+
+  // Returns the number of bytes written to decoded, or -1 if the encoded data
+  // is malformed or would decode to more than max_length bytes.
+  static int Decode(const uint8_t* const encoded, const int encoded_length,
+    uint8_t* const decoded, const int max_length);
+
+private:
+  RLE();
+};
+
+#endif // RLE_H_
@@ -0,0 +1,109 @@
+#include "run_stats.hpp"
+
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "log.hpp"
+
+static const char kHeader[] = "time,serial_port,device_type,baudrate,"
+  "program_block_size,image_bytes,blocks,handshake_seconds,erase_seconds,"
+  "program_seconds,success,program_bytes_sent,boot_seconds";
+
+bool RunStats::Append(const std::string &stats_filename) const
+{
+  // Rows are only appended under the same columns, otherwise Load would read
+  // them under the wrong names.
+  std::string existing_header;
+  {
+    std::ifstream existing_file(stats_filename);
+    std::getline(existing_file, existing_header);
+  }
+  if (!existing_header.empty() && (existing_header != kHeader))
+  {
+    Log::Error() << "ERROR: " << stats_filename << " has different columns"
+      << " from this version's stats, use a new file." << std::endl;
+    return false;
+  }
+
+  std::ofstream stats_file(stats_filename, std::ios::app);
+  if (!stats_file)
+  {
+    Log::Error() << "ERROR: Couldn't open " << stats_filename << std::endl;
+    return false;
+  }
+
+  if (stats_file.tellp() == 0)
+    stats_file << kHeader << "\n";
+
+  char time_string[32];
+  const std::time_t now = std::time(nullptr);
+  std::strftime(time_string, sizeof(time_string), "%Y-%m-%dT%H:%M:%S",
+    std::localtime(&now));
+
+  stats_file << time_string << "," << serial_port << "," << device_type << ","
+    << baudrate << "," << program_block_size << "," << image_bytes << ","
+    << blocks << "," << handshake_seconds << "," << erase_seconds << ","
+    << program_seconds << "," << (success ? 1 : 0) << ","
+    << program_bytes_sent << "," << boot_seconds << "\n";
+  return true;
+}
+
+bool RunStats::Load(const std::string &stats_filename,
+  std::vector<RunStats> &runs)
+{
+  std::ifstream stats_file(stats_filename);
+  if (!stats_file)
+  {
+    Log::Error() << "ERROR: Couldn't open " << stats_filename << std::endl;
+    return false;
+  }
+
+  std::string line, field;
+  std::vector<std::string> columns;
+  if (std::getline(stats_file, line))
+  {
+    std::istringstream header(line);
+    while (std::getline(header, field, ','))
+      columns.push_back(field);
+  }
+
+  while (std::getline(stats_file, line))
+  {
+    RunStats run;
+    std::istringstream fields(line);
+    for (size_t i = 0; (i < columns.size())
+      && std::getline(fields, field, ','); ++i)
+    {
+      const std::string &column = columns[i];
+      if (column == "serial_port")
+        run.serial_port = field;
+      else if (column == "device_type")
+        run.device_type = atoi(field.c_str());
+      else if (column == "baudrate")
+        run.baudrate = atoi(field.c_str());
+      else if (column == "program_block_size")
+        run.program_block_size = atoi(field.c_str());
+      else if (column == "image_bytes")
+        run.image_bytes = atoi(field.c_str());
+      else if (column == "blocks")
+        run.blocks = atoi(field.c_str());
+      else if (column == "handshake_seconds")
+        run.handshake_seconds = atof(field.c_str());
+      else if (column == "erase_seconds")
+        run.erase_seconds = atof(field.c_str());
+      else if (column == "program_seconds")
+        run.program_seconds = atof(field.c_str());
+      else if (column == "success")
+        run.success = field == "1";
+      else if (column == "program_bytes_sent")
+        run.program_bytes_sent = atoi(field.c_str());
+      else if (column == "boot_seconds")
+        run.boot_seconds = atof(field.c_str());
+    }
+    runs.push_back(run);
+  }
+  return true;
+}
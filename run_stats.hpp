@@ -0,0 +1,48 @@
+// Timing of one programming run, appended as a line of comma-separated values
+// to a stats file so that the runs of a production line can be analyzed.
+
+#ifndef RUN_STATS_H_
+#define RUN_STATS_H_
+
+#include <string>
+#include <vector>
+
+struct RunStats
+{
+  RunStats()
+    : device_type(0)
+    , baudrate(0)
+    , program_block_size(0)
+    , image_bytes(0)
+    , blocks(0)
+    , handshake_seconds(0.0)
+    , erase_seconds(0.0)
+    , program_seconds(0.0)
+    , success(false)
+    , program_bytes_sent(0)
+    , boot_seconds(0.0) {}
+
+  // Appends these stats to the file, starting it with a header if it is new.
+  // Fails rather than mix rows of a file with a different header.
+  bool Append(const std::string &stats_filename) const;
+
+  // Reads all of the runs recorded in a stats file. Columns are matched by the
+  // names in the header, so files from older versions can still be read.
+  static bool Load(const std::string &stats_filename,
+    std::vector<RunStats> &runs);
+
+  std::string serial_port;
+  int device_type;
+  int baudrate;
+  int program_block_size;
+  int image_bytes;
+  int blocks;
+  double handshake_seconds;
+  double erase_seconds;
+  double program_seconds;
+  bool success;
+  int program_bytes_sent;  // 0 if unknown.
+  double boot_seconds;  // Until the new program answers, 0 if unconfirmed.
+};
+
+#endif // RUN_STATS_H_
@@ -1,13 +1,29 @@
 #include "serial.hpp"
 
+#include <algorithm>
 #include <iostream>
 
+#include <fstream>
+
+#include <dirent.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <linux/serial.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
 
+#include "log.hpp"
+#include "serial_trace.hpp"
+
 
 Serial::Serial(const std::string &comport, const int baudrate)
   : id_(-1)
+  , comport_(comport)
+  , trace_(nullptr)
+  , original_port_settings_valid_(false)
+  , original_serial_flags_(-1)
 {
   int baudrate_code = B0;  // Hangup.
   switch(baudrate)
@@ -82,7 +98,7 @@ Serial::Serial(const std::string &comport, const int baudrate)
       baudrate_code = B1000000;
       break;
     default :
-      std::cerr << "Failed to open " << comport << ". Invalid baudrate."
+      Log::Error() << "Failed to open " << comport << ". Invalid baudrate."
         << std::endl;
       return;
       break;
@@ -90,7 +106,7 @@ Serial::Serial(const std::string &comport, const int baudrate)
 
   id_ = open(comport.c_str(), O_RDWR | O_NOCTTY | O_NDELAY);
   if (id_ == -1) {
-    std::cerr << "Failed to open " << comport << "." << std::endl;
+    Log::Error() << "Failed to open " << comport << "." << std::endl;
     return;
   }
 
@@ -98,19 +114,25 @@ Serial::Serial(const std::string &comport, const int baudrate)
   if (error == -1)
   {
     Close();
-    std::cerr << "ERROR: Unable to read settings on " << comport << "."
+    Log::Error() << "ERROR: Unable to read settings on " << comport << "."
       << std::endl;
       return;
   }
+  original_port_settings_valid_ = true;
 
+  // Raw mode. The port is opened non-blocking and waited on with poll (see
+  // WaitForData), so reads return whatever has arrived without any VMIN/VTIME
+  // inter-byte timer delaying them.
   struct termios new_port_settings = {0};
   new_port_settings.c_cflag = baudrate_code | CS8 | CLOCAL | CREAD;
   new_port_settings.c_iflag = IGNPAR;
+  new_port_settings.c_cc[VMIN] = 0;
+  new_port_settings.c_cc[VTIME] = 0;
   error = tcsetattr(id_, TCSANOW, &new_port_settings);
   if (error == -1)
   {
     Close();
-    std::cerr << "ERROR: Unable to adjust settings on " << comport << "."
+    Log::Error() << "ERROR: Unable to adjust settings on " << comport << "."
       << std::endl;
     return;
   }
@@ -121,7 +143,10 @@ int Serial::Read(uint8_t* const buffer, const int length) const
   if (id_ == -1)
     return -1;
 
-  return read(id_, buffer, length);
+  const int bytes_read = read(id_, buffer, length);
+  if (trace_ && (bytes_read > 0))
+    trace_->Record(SerialTrace::DIRECTION_RX, buffer, bytes_read);
+  return bytes_read;
 }
 
 int Serial::SendByte(const uint8_t byte) const
@@ -135,14 +160,112 @@ int Serial::SendBuffer(const uint8_t* const buffer, const int length)
   if (id_ == -1)
     return -1;
 
-  return write(id_, buffer, length);
+  const int bytes_written = write(id_, buffer, length);
+  if (trace_ && (bytes_written > 0))
+    trace_->Record(SerialTrace::DIRECTION_TX, buffer, bytes_written);
+  return bytes_written;
+}
+
+std::vector<std::string> Serial::ListPorts()
+{
+  std::vector<std::string> ports;
+  DIR* dev = opendir("/dev");
+  if (!dev)
+    return ports;
+
+  while (const struct dirent* entry = readdir(dev))
+  {
+    const std::string name = entry->d_name;
+    if (!name.compare(0, 6, "ttyUSB") || !name.compare(0, 6, "ttyACM"))
+      ports.push_back("/dev/" + name);
+  }
+  closedir(dev);
+
+  std::sort(ports.begin(), ports.end());
+  return ports;
+}
+
+bool Serial::WaitForData(const int timeout_ms) const
+{
+  if (id_ == -1)
+    return false;
+
+  struct pollfd poll_fd = { id_, POLLIN, 0 };
+  return (poll(&poll_fd, 1, timeout_ms) > 0) && (poll_fd.revents & POLLIN);
+}
+
+bool Serial::SetLowLatency(const bool low_latency)
+{
+  if (id_ == -1)
+    return false;
+
+  bool supported = false;
+
+  struct serial_struct serial_info;
+  if (ioctl(id_, TIOCGSERIAL, &serial_info) == 0)
+  {
+    if (original_serial_flags_ == -1)
+      original_serial_flags_ = serial_info.flags;
+    if (low_latency)
+      serial_info.flags |= ASYNC_LOW_LATENCY;
+    else
+      serial_info.flags = original_serial_flags_;
+    supported = ioctl(id_, TIOCSSERIAL, &serial_info) == 0;
+    if (!low_latency)
+      original_serial_flags_ = -1;
+  }
+
+  const std::string latency_timer_path = LatencyTimerPath();
+  if (!latency_timer_path.empty())
+  {
+    if (original_latency_timer_.empty())
+    {
+      std::ifstream latency_timer(latency_timer_path);
+      latency_timer >> original_latency_timer_;
+    }
+    if (!original_latency_timer_.empty())
+    {
+      std::ofstream latency_timer(latency_timer_path);
+      latency_timer << (low_latency ? "1" : original_latency_timer_)
+        << std::endl;
+      supported = supported || latency_timer.good();
+      if (!low_latency)
+        original_latency_timer_.clear();
+    }
+  }
+
+  return supported;
 }
 
 void Serial::Close()
 {
+  if (id_ == -1)
+    return;
+
+  // Restore the original settings while the port is still open.
+  if ((original_serial_flags_ != -1) || !original_latency_timer_.empty())
+    SetLowLatency(false);
+  if (original_port_settings_valid_)
+    tcsetattr(id_, TCSANOW, &original_port_settings_);
   close(id_);
-  tcsetattr(id_, TCSANOW, &original_port_settings_);
   id_ = -1;
 }
 
+// ============================================================================+
+// Private  functions:
+
+// The sysfs latency timer of a USB serial adapter, if it can be written.
+std::string Serial::LatencyTimerPath() const
+{
+  char real_path[PATH_MAX];
+  if (!realpath(comport_.c_str(), real_path))
+    return std::string();
+  std::string name = real_path;
+  name = name.substr(name.find_last_of('/') + 1);
+
+  const std::string path = "/sys/bus/usb-serial/devices/" + name
+    + "/latency_timer";
+  return access(path.c_str(), W_OK) == 0 ? path : std::string();
+}
+
 
@@ -3,25 +3,53 @@
 
 #include <cinttypes>
 #include <string>
+#include <vector>
 
 #include <termios.h>
 
+class SerialTrace;
+
 class Serial
 {
 public:
-  Serial() : id_(-1) {}
+  Serial() : id_(-1), trace_(nullptr), original_port_settings_valid_(false)
+    , original_serial_flags_(-1) {}
   Serial(const std::string &comport, const int baudrate);
+  ~Serial() { Close(); }
 
   operator bool() const { return id_ != -1; }
 
   int Read(uint8_t* const buffer, const int length) const;
   int SendByte(const uint8_t byte) const;
   int SendBuffer(const uint8_t* const buffer, const int length) const;
+  // Waits up to timeout_ms for received data. Returns true if there is some.
+  bool WaitForData(const int timeout_ms) const;
   void Close();
 
+  // Low-latency mode asks the driver to pass received bytes on immediately
+  // (ASYNC_LOW_LATENCY) and, for USB adapters that have one (e.g. FTDI), sets
+  // the latency timer to 1 ms instead of the usual 16 ms. The original
+  // settings are restored on Close. Returns false if neither is supported.
+  bool SetLowLatency(const bool low_latency);
+
+  // Device names of the USB and on-board serial ports that are present.
+  static std::vector<std::string> ListPorts();
+
+  // Record all traffic on this port to the given trace (or nullptr to stop).
+  void set_trace(SerialTrace* const trace) { trace_ = trace; }
+
 private:
+  Serial(const Serial&);
+
+  std::string LatencyTimerPath() const;
+
   int id_;
+  std::string comport_;
+  SerialTrace* trace_;
   struct termios original_port_settings_;
+  bool original_port_settings_valid_;
+  int original_serial_flags_;  // -1 if unchanged.
+  std::string original_latency_timer_;  // Empty if unchanged.
 };
 
 #endif // SERIAL_H_
\ No newline at end of file
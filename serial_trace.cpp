@@ -0,0 +1,158 @@
+#include "serial_trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "log.hpp"
+
+static const char kMagic[8] = { 'M', 'K', 'T', 'R', 'A', 'C', 'E', '1' };
+
+SerialTrace::SerialTrace(const std::string &trace_filename)
+  : file_(fopen(trace_filename.c_str(), "wb"))
+  , start_(std::chrono::steady_clock::now())
+  , ring_(kRingSize)
+  , head_(0)
+  , tail_(0)
+  , stop_(false)
+  , dropped_records_(0)
+{
+  if (!file_)
+  {
+    Log::Error() << "ERROR: Couldn't open " << trace_filename << std::endl;
+    return;
+  }
+  fwrite(kMagic, 1, sizeof(kMagic), file_);
+  flush_thread_ = std::thread(&SerialTrace::Flush, this);
+}
+
+SerialTrace::~SerialTrace()
+{
+  stop_ = true;
+  if (flush_thread_.joinable())
+    flush_thread_.join();
+  if (file_)
+    fclose(file_);
+  if (dropped_records_)
+    Log::Error() << "WARNING: Serial trace dropped " << dropped_records_
+      << " record(s)." << std::endl;
+}
+
+void SerialTrace::Record(const enum Direction direction,
+  const uint8_t* const data, const int length)
+{
+  if (!file_ || (length < 1))
+    return;
+
+  const size_t head = head_.load(std::memory_order_relaxed);
+  const size_t free_space = kRingSize - (head - tail_.load(
+    std::memory_order_acquire));
+  if (length > 0xFFFF || kRecordHeaderSize + length > free_space)
+  {
+    ++dropped_records_;
+    return;
+  }
+
+  const uint64_t timestamp = std::chrono::duration_cast<
+    std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_)
+    .count();
+  uint8_t header[kRecordHeaderSize];
+  for (int i = 0; i < 8; ++i)
+    header[i] = (uint8_t)(timestamp >> (8 * i));
+  header[8] = direction;
+  header[9] = (uint8_t)(length & 0xFF);
+  header[10] = (uint8_t)((length >> 8) & 0xFF);
+
+  size_t position = WriteToRing(head, header, sizeof(header));
+  position = WriteToRing(position, data, length);
+  head_.store(position, std::memory_order_release);
+}
+
+bool SerialTrace::ReadFile(const std::string &trace_filename,
+  std::vector<Chunk> &chunks)
+{
+  std::ifstream trace_file(trace_filename, std::ios::binary);
+  if (!trace_file)
+  {
+    Log::Error() << "ERROR: Couldn't open " << trace_filename << std::endl;
+    return false;
+  }
+
+  char magic[sizeof(kMagic)];
+  if (!trace_file.read(magic, sizeof(magic))
+    || memcmp(magic, kMagic, sizeof(kMagic)))
+  {
+    Log::Error() << "ERROR: " << trace_filename << " is not a serial trace."
+      << std::endl;
+    return false;
+  }
+
+  uint8_t header[kRecordHeaderSize];
+  while (trace_file.read(reinterpret_cast<char*>(header), sizeof(header)))
+  {
+    Chunk chunk;
+    chunk.timestamp = 0;
+    for (int i = 0; i < 8; ++i)
+      chunk.timestamp |= (uint64_t)header[i] << (8 * i);
+    chunk.direction = header[8] ? DIRECTION_RX : DIRECTION_TX;
+    chunk.data.resize(header[9] | (header[10] << 8));
+    if (!trace_file.read(reinterpret_cast<char*>(chunk.data.data()),
+      chunk.data.size()))
+    {
+      Log::Error() << "WARNING: " << trace_filename << " ends with a truncated"
+        << " chunk." << std::endl;
+      break;
+    }
+    chunks.push_back(std::move(chunk));
+  }
+  return true;
+}
+
+// ============================================================================+
+// Private  functions:
+
+// Runs on the flush thread: drains the ring buffer into the file.
+void SerialTrace::Flush()
+{
+  for (bool stopping = false; ; )
+  {
+    // Read stop_ before head_ so that the final drain sees every chunk.
+    stopping = stop_.load();
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t available = head_.load(std::memory_order_acquire) - tail;
+    if (available)
+    {
+      const size_t start = tail & (kRingSize - 1);
+      const size_t first = std::min(available, kRingSize - start);
+      fwrite(ring_.data() + start, 1, first, file_);
+      fwrite(ring_.data(), 1, available - first, file_);
+      tail_.store(tail + available, std::memory_order_release);
+    }
+    else if (stopping)
+    {
+      break;
+    }
+    else
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+  }
+  fflush(file_);
+}
+
+// -----------------------------------------------------------------------------
+// Copies data into the ring buffer at the given position, wrapping at the end,
+// and returns the position following it. The caller publishes the new head
+// once the whole record has been written.
+size_t SerialTrace::WriteToRing(const size_t position,
+  const uint8_t* const data, const size_t length)
+{
+  static_assert((kRingSize & (kRingSize - 1)) == 0,
+    "kRingSize must be a power of 2");
+  const size_t start = position & (kRingSize - 1);
+  const size_t first = std::min(length, kRingSize - start);
+  memcpy(ring_.data() + start, data, first);
+  memcpy(ring_.data(), data + first, length - first);
+  return position + length;
+}
@@ -0,0 +1,72 @@
+// Low-overhead binary trace of the bytes sent and received on a serial port.
+// Records are copied into a lock-free single-producer/single-consumer ring
+// buffer by the thread using the port and written to a file by a background
+// thread, so recording never blocks on disk I/O.
+//
+// File format (little-endian): the 8-byte magic "MKTRACE1", followed by
+// records of { uint64 timestamp (ns since trace start), uint8 direction,
+// uint16 length, length data bytes }.
+
+#ifndef SERIAL_TRACE_H_
+#define SERIAL_TRACE_H_
+
+#include <atomic>
+#include <cinttypes>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+class SerialTrace
+{
+public:
+  enum Direction
+  {
+    DIRECTION_TX = 0,
+    DIRECTION_RX = 1,
+  };
+
+  struct Chunk
+  {
+    uint64_t timestamp;  // Nanoseconds since the trace was started.
+    enum Direction direction;
+    std::vector<uint8_t> data;
+  };
+
+  SerialTrace(const std::string &trace_filename);
+  ~SerialTrace();
+
+  operator bool() const { return file_ != nullptr; }
+
+  // Called only by the thread that uses the serial port. If the ring buffer is
+  // full the record is dropped (and counted) rather than blocking.
+  void Record(const enum Direction direction, const uint8_t* const data,
+    const int length);
+
+  // Reads all of the chunks from a trace file.
+  static bool ReadFile(const std::string &trace_filename,
+    std::vector<Chunk> &chunks);
+
+private:
+  SerialTrace();
+  SerialTrace(const SerialTrace&);
+
+  void Flush();
+  size_t WriteToRing(const size_t position, const uint8_t* const data,
+    const size_t length);
+
+  static constexpr size_t kRingSize = 1 << 20;  // Must be a power of 2.
+  static constexpr size_t kRecordHeaderSize = 11;
+
+  FILE* file_;
+  const std::chrono::steady_clock::time_point start_;
+  std::vector<uint8_t> ring_;
+  std::atomic<size_t> head_;  // Total bytes written by the producer.
+  std::atomic<size_t> tail_;  // Total bytes consumed by the flush thread.
+  std::atomic<bool> stop_;
+  size_t dropped_records_;
+  std::thread flush_thread_;
+};
+
+#endif // SERIAL_TRACE_H_
@@ -0,0 +1,26 @@
+#ifndef SHA256_H_
+#define SHA256_H_
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+
+class SHA256
+{
+public:
+  SHA256();
+  void Update(const uint8_t* const data, const size_t length);
+
+  // Finalizes the digest and returns it as a lowercase hexadecimal string.
+  std::string result();
+
+private:
+  void ProcessBlock(const uint8_t* const block);
+
+  uint32_t state_[8];
+  uint8_t block_[64];
+  size_t block_length_;
+  uint64_t total_length_;
+};
+
+#endif // SHA256_H_
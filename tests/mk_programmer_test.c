@@ -0,0 +1,102 @@
+/* Checks that libmkprogrammer loads a good image and turns malformed hex files
+ * into errors (rather than crashes or exceptions) through its C interface.
+ * Run with "make check".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mk_programmer.h"
+
+static int failures = 0;
+
+static void Message(void *user_data, int is_error, const char *line)
+{
+  (void)line;
+  if (is_error)
+    ++*(int*)user_data;
+}
+
+/* Writes the text to a new temporary file, whose name is left in filename. */
+static void WriteFile(char filename[32], const char *text)
+{
+  FILE *file;
+  int fd;
+  strcpy(filename, "/tmp/mkp_test_XXXXXX");
+  fd = mkstemp(filename);
+  file = fd < 0 ? NULL : fdopen(fd, "w");
+  if (!file)
+  {
+    perror("mkstemp");
+    exit(1);
+  }
+  fputs(text, file);
+  fclose(file);
+}
+
+/* Loads the text as a hex file and checks whether that succeeded. */
+static void CheckLoad(const char *name, const char *text, const int valid)
+{
+  char filename[32];
+  const char *filenames[1];
+  int errors = 0;
+  mkp_callbacks callbacks = { Message, NULL, NULL };
+  mkp_image *image;
+  callbacks.user_data = &errors;
+
+  WriteFile(filename, text);
+  filenames[0] = filename;
+  image = mkp_image_load(filenames, 1, &callbacks);
+  if ((image != NULL) != valid || (errors == 0) != valid)
+  {
+    printf("FAIL: %s: %s with %d error(s)\n", name,
+      image ? "loaded" : "not loaded", errors);
+    ++failures;
+  }
+  else if (image)
+  {
+    char digest[65];
+    mkp_image_digest(image, digest);
+    if ((mkp_image_size(image) != 4) || (strlen(digest) != 64))
+    {
+      printf("FAIL: %s: %d bytes, digest \"%s\"\n", name,
+        mkp_image_size(image), digest);
+      ++failures;
+    }
+  }
+  mkp_image_free(image);
+  unlink(filename);
+}
+
+int main(void)
+{
+  CheckLoad("valid",
+    ":0400000001020304F2\r\n"
+    ":00000001FF\r\n", 1);
+  CheckLoad("non-hex digit",
+    ":04000000010G0304F2\n"
+    ":00000001FF\n", 0);
+  CheckLoad("short line",
+    ":0400000001020304F2\n"
+    ":0400\n"
+    ":00000001FF\n", 0);
+  CheckLoad("byte count too large",
+    ":0800000001020304F2\n"
+    ":00000001FF\n", 0);
+  CheckLoad("checksum",
+    ":0400000001020304F3\n"
+    ":00000001FF\n", 0);
+  CheckLoad("end of file record checksum",
+    ":0400000001020304F2\n"
+    ":00000001FE\n", 0);
+  CheckLoad("no end of file record",
+    ":0400000001020304F2\n", 0);
+  CheckLoad("empty", "", 0);
+
+  if (failures)
+    return 1;
+  printf("All tests passed.\n");
+  return 0;
+}
@@ -0,0 +1,197 @@
+#include "trace_decoder.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <iomanip>
+#include <sstream>
+
+static std::string Hex(const int value, const int digits)
+{
+  std::ostringstream stream;
+  stream << "0x" << std::hex << std::uppercase << std::setw(digits)
+    << std::setfill('0') << value;
+  return stream.str();
+}
+
+bool TraceDecoder::Print(const std::string &trace_filename, std::ostream &out)
+{
+  std::vector<SerialTrace::Chunk> chunks;
+  if (!SerialTrace::ReadFile(trace_filename, chunks))
+    return false;
+
+  out << std::fixed << std::setprecision(3);
+
+  // Commands may be split over several writes (e.g. a block header, its data,
+  // and its CRC), so TX bytes are collected until a command is complete.
+  std::vector<uint8_t> tx_buffer;
+  uint64_t tx_timestamp = 0;
+  for (const SerialTrace::Chunk &chunk : chunks)
+  {
+    const double milliseconds = chunk.timestamp / 1e6;
+    if (chunk.direction == SerialTrace::DIRECTION_RX)
+    {
+      out << std::setw(12) << milliseconds << " ms  RX  "
+        << DescribeResponse(chunk.data) << "\n";
+      continue;
+    }
+
+    if (tx_buffer.empty())
+      tx_timestamp = chunk.timestamp;
+    tx_buffer.insert(tx_buffer.end(), chunk.data.begin(), chunk.data.end());
+
+    std::string description;
+    while (int length = DescribeCommand(tx_buffer, description))
+    {
+      out << std::setw(12) << tx_timestamp / 1e6 << " ms  TX  " << description
+        << "\n";
+      tx_buffer.erase(tx_buffer.begin(), tx_buffer.begin() + length);
+      tx_timestamp = chunk.timestamp;
+    }
+  }
+
+  if (!tx_buffer.empty())
+    out << std::setw(12) << tx_timestamp / 1e6 << " ms  TX  incomplete command ("
+      << tx_buffer.size() << " byte(s))\n";
+  return true;
+}
+
+// ============================================================================+
+// Private  functions:
+
+int TraceDecoder::DescribeCommand(const std::vector<uint8_t> &buffer,
+  std::string &description)
+{
+  if (buffer.empty())
+    return 0;
+
+  std::ostringstream stream;
+  int length = 1;
+  switch (buffer[0])
+  {
+    case '#':
+    {
+      // MikroKopter serial protocol frame: '#', address + 'a', command,
+      // encoded data, 2 checksum characters, and '\r'.
+      auto end = std::find(buffer.begin(), buffer.end(), '\r');
+      if (end == buffer.end())
+        return 0;
+      length = end - buffer.begin() + 1;
+      if (length < 6)
+      {
+        stream << "malformed frame (" << length << " byte(s))";
+        break;
+      }
+      stream << "frame to address " << buffer[1] - 'a' << ", command '"
+        << buffer[2] << "', " << length - 6 << " encoded data byte(s)";
+      break;
+    }
+    case '\r':
+      // Padding following a frame.
+      while ((length < (int)buffer.size()) && (buffer[length] == '\r'))
+        ++length;
+      stream << "end of frame padding (" << length << " byte(s))";
+      break;
+    case 0x1B:
+    {
+      // The sequence that ends a NaviCtrl redirect also starts with 0x1B.
+      const uint8_t end_redirect[5] = { 0x1B, 0x1B, 0x55, 0xAA, 0x00 };
+      if ((buffer.size() >= sizeof(end_redirect)) && std::equal(
+        end_redirect, end_redirect + sizeof(end_redirect), buffer.begin()))
+      {
+        length = sizeof(end_redirect);
+        stream << "end of NaviCtrl redirect";
+        break;
+      }
+      stream << "bootloader wake-up (" << Hex(buffer[0], 2) << ")";
+      break;
+    }
+    case 0xAA:
+      stream << "bootloader wake-up (" << Hex(buffer[0], 2) << ")";
+      break;
+    case 't':
+      stream << "read device signature";
+      break;
+    case 'V':
+      stream << "read bootloader version";
+      break;
+    case 'b':
+      stream << "read program block size";
+      break;
+    case 'z':
+      stream << "query compressed transfer support";
+      break;
+    case 'e':
+      stream << "clear flash";
+      break;
+    case 'E':
+      stream << "exit bootloader";
+      break;
+    case 'T':
+      length = 2;
+      if ((int)buffer.size() < length)
+        return 0;
+      stream << "set device " << Hex(buffer[1], 2);
+      break;
+    case 'A':
+      length = 3;
+      if ((int)buffer.size() < length)
+        return 0;
+      stream << "set address " << Hex((buffer[1] << 8) | buffer[2], 4);
+      break;
+    case 'X':
+      length = 4;
+      if ((int)buffer.size() < length)
+        return 0;
+      stream << "set clear size " << ((buffer[1] << 16) | (buffer[2] << 8)
+        | buffer[3]) << " bytes";
+      break;
+    case 'B':
+    {
+      if (buffer.size() < 4)
+        return 0;
+      const int payload_size = (buffer[1] << 8) | buffer[2];
+      length = 4 + payload_size + 2;
+      if ((int)buffer.size() < length)
+        return 0;
+      stream << "block load " << payload_size << " bytes"
+        << (buffer[3] == 'Z' ? " (compressed)" : "") << ", CRC "
+        << Hex((buffer[length - 2] << 8) | buffer[length - 1], 4);
+      break;
+    }
+    case 'g':
+      length = 4;
+      if ((int)buffer.size() < length)
+        return 0;
+      stream << "block read " << ((buffer[1] << 8) | buffer[2]) << " bytes";
+      break;
+    default:
+      stream << "unknown byte " << Hex(buffer[0], 2);
+      break;
+  }
+
+  description = stream.str();
+  return length;
+}
+
+// -----------------------------------------------------------------------------
+std::string TraceDecoder::DescribeResponse(const std::vector<uint8_t> &data)
+{
+  const std::string text(data.begin(), data.end());
+  if (text == "\r")
+    return "okay (0x0D)";
+  if (text.find("MKBL") != std::string::npos)
+    return "bootloader ready (\"MKBL\")";
+  if ((data.size() >= 3) && (data[0] == '#'))
+    return "frame from address " + std::to_string(data[1] - 'a')
+      + ", command '" + text.substr(2, 1) + "'";
+
+  std::ostringstream stream;
+  stream << data.size() << " byte(s):";
+  for (uint8_t byte : data)
+    stream << " " << Hex(byte, 2).substr(2);
+  stream << " \"";
+  for (uint8_t byte : data)
+    stream << (isprint(byte) ? (char)byte : '.');
+  stream << "\"";
+  return stream.str();
+}
@@ -0,0 +1,27 @@
+#ifndef TRACE_DECODER_H_
+#define TRACE_DECODER_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "serial_trace.hpp"
+
+// Renders a serial trace as MikroKopter bootloader commands, serial protocol
+// frames, and device responses.
+class TraceDecoder
+{
+public:
+  static bool Print(const std::string &trace_filename, std::ostream &out);
+
+private:
+  TraceDecoder();
+
+  // Describes the TX command at the start of buffer. Returns the number of
+  // bytes it occupies, or 0 if the command is not yet complete.
+  static int DescribeCommand(const std::vector<uint8_t> &buffer,
+    std::string &description);
+  static std::string DescribeResponse(const std::vector<uint8_t> &data);
+};
+
+#endif // TRACE_DECODER_H_
@@ -0,0 +1,107 @@
+#include "trace_replay.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "log.hpp"
+
+TraceReplay::TraceReplay(const std::string &trace_filename,
+  const double speed)
+  : speed_(speed)
+  , stop_(false)
+{
+  if (speed_ <= 0.0)
+  {
+    Log::Error() << "ERROR: Replay speed must be positive." << std::endl;
+    return;
+  }
+
+  std::vector<SerialTrace::Chunk> chunks;
+  if (!SerialTrace::ReadFile(trace_filename, chunks))
+    return;
+
+  size_t tx_bytes = 0;
+  const SerialTrace::Chunk* request = nullptr;
+  bool receiving = false;
+  for (const SerialTrace::Chunk &chunk : chunks)
+  {
+    if (chunk.direction == SerialTrace::DIRECTION_TX)
+    {
+      tx_bytes += chunk.data.size();
+      request = &chunk;
+      receiving = false;
+    }
+    else if (request)
+    {
+      // Received chunks with nothing sent in between make up one response.
+      if (!receiving)
+      {
+        responses_.push_back({ tx_bytes, request->data, {} });
+        tx_bytes = 0;
+        receiving = true;
+      }
+      responses_.back().parts.push_back({ chunk.timestamp - request->timestamp,
+        chunk.data });
+    }
+  }
+  if (responses_.empty())
+  {
+    Log::Error() << "ERROR: " << trace_filename
+      << " contains no device responses." << std::endl;
+    return;
+  }
+
+  if (pseudo_terminal_)
+    thread_ = std::thread(&TraceReplay::Run, this);
+}
+
+TraceReplay::~TraceReplay()
+{
+  stop_ = true;
+  if (thread_.joinable())
+    thread_.join();
+}
+
+// ============================================================================+
+// Private  functions:
+
+void TraceReplay::Run()
+{
+  std::vector<uint8_t> tx_buffer;
+  auto request_time = std::chrono::steady_clock::now();
+  uint8_t rx_buffer[255];
+
+  for (const Response &response : responses_)
+  {
+    // Wait for the programmer to send the request that this is a response to.
+    tx_buffer.clear();
+    while ((tx_buffer.size() < response.tx_bytes) || (tx_buffer.size()
+      < response.request.size()) || !std::equal(response.request.begin(),
+      response.request.end(), tx_buffer.end() - response.request.size()))
+    {
+      if (stop_)
+        return;
+      const int bytes_read = pseudo_terminal_.Read(rx_buffer,
+        sizeof(rx_buffer), 100);
+      if (bytes_read)
+      {
+        tx_buffer.insert(tx_buffer.end(), rx_buffer, rx_buffer + bytes_read);
+        request_time = std::chrono::steady_clock::now();
+      }
+    }
+
+    for (const Part &part : response.parts)
+    {
+      std::this_thread::sleep_until(request_time + std::chrono::nanoseconds(
+        (uint64_t)(part.delay / speed_)));
+      if (stop_)
+        return;
+      pseudo_terminal_.Write(part.data.data(), part.data.size());
+    }
+  }
+
+  // Keep draining whatever else the programmer sends.
+  while (!stop_)
+    pseudo_terminal_.Read(rx_buffer, sizeof(rx_buffer), 100);
+}
@@ -0,0 +1,60 @@
+// Plays back the device side of a recorded serial trace through a pseudo
+// terminal so that the programmer can be run against it without hardware.
+// Each response (the received chunks between two sent ones) is released once
+// the programmer has sent at least as many bytes since the previous response
+// as in the recording, ending with the same request. Each of its chunks then
+// follows after the same delay (scaled by the replay speed) as it did after
+// that request.
+
+#ifndef TRACE_REPLAY_H_
+#define TRACE_REPLAY_H_
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pseudo_terminal.hpp"
+#include "serial_trace.hpp"
+
+class TraceReplay
+{
+public:
+  // A speed of 2.0 replays twice as fast as recorded, 0.5 half as fast.
+  TraceReplay(const std::string &trace_filename, const double speed);
+  ~TraceReplay();
+
+  operator bool() const { return pseudo_terminal_ && !responses_.empty(); }
+
+  // The name of the pseudo terminal to open in place of a serial port.
+  std::string port_name() const { return pseudo_terminal_.port_name(); }
+
+private:
+  TraceReplay();
+  TraceReplay(const TraceReplay&);
+
+  struct Part
+  {
+    uint64_t delay;  // Nanoseconds after the request was sent.
+    std::vector<uint8_t> data;
+  };
+
+  struct Response
+  {
+    size_t tx_bytes;  // Bytes sent since the previous response.
+    std::vector<uint8_t> request;  // The last chunk sent before this response.
+    // A response may have been received in several reads (e.g. a block read
+    // typically arrives as 255 + 1 bytes).
+    std::vector<Part> parts;
+  };
+
+  void Run();
+
+  const double speed_;
+  std::vector<Response> responses_;
+  PseudoTerminal pseudo_terminal_;
+  std::atomic<bool> stop_;
+  std::thread thread_;
+};
+
+#endif // TRACE_REPLAY_H_